@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "corpus.h"
+#include "counters.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+// every measurement repeats the count until at least this long has passed, so 
+// small corpora still give stable numbers.
+constexpr double MIN_SECONDS { 0.05 };
+
+const char* program_name;
+
+struct BenchOptions
+{
+    std::vector<uint64_t> sizes { 1 << 10, 1 << 20, 64 << 20 };
+    std::vector<CorpusKind> kinds { all_corpus_kinds() };
+    int repeat { 3 };
+    std::string csv_path {};
+    std::string json_path {};
+};
+
+// one counter over one corpus, at the best speed of the repeats.
+struct BenchResult
+{
+    std::string corpus {};
+    uint64_t size {};
+    std::string counter {};
+    uint64_t count {};
+    double seconds {}; // for a single pass
+};
+
+// the counters ccwc uses, each run over a whole corpus.
+struct Counter
+{
+    const char* name;
+    uint64_t (*run)(const uint8_t* data, size_t size);
+};
+
+const Counter COUNTERS[] {
+    { "lines", [](const uint8_t* data, size_t size) { return count_newlines(data, size); } },
+    { "words", [](const uint8_t* data, size_t size) { bool in_word {}; return count_words(data, size, in_word); } },
+    { "chars", [](const uint8_t* data, size_t size) { return count_chars(data, size); } },
+    { "all", [](const uint8_t* data, size_t size) 
+        { 
+            Counts counts {}; 
+            CountState state {}; 
+            count_span(data, size, counts, state); 
+            return counts.lines + counts.words + counts.chars; 
+        } },
+};
+
+void print_usage(std::ostream& stream)
+{
+    stream << "Measures the ccwc counters on generated corpora and writes the results as CSV or JSON.\n\n"
+           << "Usage: " << program_name << " <-h> <--sizes list> <--corpora list> <--repeat n> <--csv path> <--json path>\n"
+           << "\t-h display this usage information.\n"
+           << "\t--sizes comma separated corpus sizes with an optional K, M or G suffix (default 1K,1M,64M).\n"
+           << "\t--corpora comma separated corpus kinds: random, skewed, text, logs, binary (default all).\n"
+           << "\t--repeat run every measurement this many times and keep the best (default 3).\n"
+           << "\t--csv write the results as CSV to the given path, - for standard output.\n"
+           << "\t--json write the results as JSON to the given path, - for standard output.\n"
+           << "\t   Without --csv or --json, CSV goes to standard output.\n";
+}
+
+std::vector<std::string> split_list(const std::string& text)
+{
+    std::vector<std::string> items {};
+    std::stringstream stream { text };
+    std::string item {};
+    while (std::getline(stream, item, ','))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+bool process_arguments(BenchOptions& opts, int argc, char* argv[])
+{
+    program_name = argv[0];
+    int opt {};
+    const char* opt_flags { "h" };
+    const option long_opts[] {
+        { "sizes", required_argument, nullptr, 's' },
+        { "corpora", required_argument, nullptr, 'k' },
+        { "repeat", required_argument, nullptr, 'r' },
+        { "csv", required_argument, nullptr, 'C' },
+        { "json", required_argument, nullptr, 'J' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    while ((opt = getopt_long(argc, argv, opt_flags, long_opts, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            print_usage(std::cout);
+            std::exit(0);
+        case 's':
+            opts.sizes.clear();
+            for (const std::string& item : split_list(optarg))
+            {
+                uint64_t size {};
+                if (!parse_size(item, size) || size == 0)
+                {
+                    std::cerr << "Error: invalid corpus size " << item << ".\n";
+                    return false;
+                }
+                opts.sizes.push_back(size);
+            }
+            break;
+        case 'k':
+            opts.kinds.clear();
+            for (const std::string& item : split_list(optarg))
+            {
+                CorpusKind kind {};
+                if (!parse_corpus_kind(item, kind))
+                {
+                    std::cerr << "Error: unknown corpus " << item << ".\n";
+                    return false;
+                }
+                opts.kinds.push_back(kind);
+            }
+            break;
+        case 'r':
+            opts.repeat = std::atoi(optarg);
+            if (opts.repeat < 1)
+            {
+                std::cerr << "Error: repeat count must be at least 1.\n";
+                return false;
+            }
+            break;
+        case 'C':
+            opts.csv_path = optarg;
+            break;
+        case 'J':
+            opts.json_path = optarg;
+            break;
+        case '?':
+            print_usage(std::cerr);
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    if (opts.csv_path.empty() && opts.json_path.empty())
+    {
+        opts.csv_path = "-";
+    }
+
+    return true;
+}
+
+void measure_counter(const Counter& counter, const std::vector<uint8_t>& corpus, int repeat, BenchResult& result)
+{
+    result.counter = counter.name;
+    result.seconds = 1e30;
+    for (int run = 0; run < repeat; ++run)
+    {
+        auto start { std::chrono::steady_clock::now() };
+        double elapsed { 0.0 };
+        uint64_t passes { 0 };
+        do
+        {
+            result.count = counter.run(corpus.data(), corpus.size());
+            asm volatile("" : : "r"(result.count) : "memory");
+            ++passes;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < MIN_SECONDS);
+        result.seconds = std::min(result.seconds, elapsed / passes);
+    }
+}
+
+double gigabytes_per_second(const BenchResult& result)
+{
+    return result.seconds > 0.0 ? result.size / result.seconds / 1e9 : 0.0;
+}
+
+void write_csv(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "version,corpus,size,counter,count,seconds,gb_s\n";
+    for (const BenchResult& result : results)
+    {
+        out << BENCH_VERSION << ',' << result.corpus << ',' << result.size << ',' << result.counter << ','
+            << result.count << ',' << result.seconds << ',' << gigabytes_per_second(result) << '\n';
+    }
+}
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "{\n  \"version\": \"" << BENCH_VERSION << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& result { results[i] };
+        out << (i > 0 ? "," : "") << "\n    { "
+            << "\"corpus\": \"" << result.corpus << "\", \"size\": " << result.size
+            << ", \"counter\": \"" << result.counter << "\", \"count\": " << result.count
+            << ", \"seconds\": " << result.seconds << ", \"gb_s\": " << gigabytes_per_second(result) << " }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool write_results(const std::string& path, const std::vector<BenchResult>& results, void (*write)(std::ostream&, const std::vector<BenchResult>&))
+{
+    if (path.empty())
+    {
+        return true;
+    }
+    if (path == "-")
+    {
+        write(std::cout, results);
+        return static_cast<bool>(std::cout);
+    }
+
+    std::ofstream file { path };
+    write(file, results);
+    file.close();
+    if (file.fail())
+    {
+        std::cerr << "Error: failed to write " << path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions opts {};
+    if (!process_arguments(opts, argc, argv))
+    {
+        return 1;
+    }
+
+    std::vector<BenchResult> results {};
+    std::vector<uint8_t> corpus {};
+    for (CorpusKind kind : opts.kinds)
+    {
+        for (uint64_t size : opts.sizes)
+        {
+            // the corpus is counted in memory, so only the counters are measured.
+            corpus.resize(size);
+            CorpusGenerator { kind }.generate(corpus.data(), corpus.size());
+
+            for (const Counter& counter : COUNTERS)
+            {
+                BenchResult result {};
+                result.corpus = corpus_name(kind);
+                result.size = size;
+                measure_counter(counter, corpus, opts.repeat, result);
+                std::cerr << result.corpus << ' ' << size << ' ' << result.counter << ": " 
+                          << gigabytes_per_second(result) << " GB/s\n";
+                results.push_back(result);
+            }
+        }
+    }
+
+    bool ok { write_results(opts.csv_path, results, write_csv) };
+    ok = write_results(opts.json_path, results, write_json) && ok;
+
+    return ok ? 0 : 1;
+}
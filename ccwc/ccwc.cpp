@@ -1,10 +1,17 @@
+#include <cstdint>
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <string>
 #include <filesystem>
+#include <vector>
 #include <unistd.h>
 
+#include "counters.h"
+#include "input_source.h"
+
+// the input is counted in spans of this size when it has to be read.
+constexpr size_t READ_SIZE { 1 << 20 };
+
 const char* program_name;
 
 struct Options
@@ -25,7 +32,7 @@ void print_usage(std::ostream& stream)
            << "\t-m count the number of characters in a given file.\n";
 }
 
-bool process_arguments(std::istream*& in, std::string& filepath, Options& opts, int argc, char* argv[])
+bool process_arguments(InputSource& in, std::string& filepath, Options& opts, int argc, char* argv[])
 {
     program_name = argv[0];
     int opt {};
@@ -58,7 +65,7 @@ bool process_arguments(std::istream*& in, std::string& filepath, Options& opts,
         }
     }
 
-    // when a filepath is given we want to error check and unload to istream
+    // when a filepath is given we want to error check and open it
     if (optind < argc) 
     {
         filepath = argv[optind];
@@ -76,146 +83,47 @@ bool process_arguments(std::istream*& in, std::string& filepath, Options& opts,
             return false;
         }
 
-        static std::ifstream file { filepath, std::ios::in | std::ios::binary };
-        if (!file.is_open())
+        if (!in.open(filepath))
         {
             std::cerr << "Error: file " << filepath << " could not be opened.\n";
             return false;
         }
-
-        in = &file;
     }
     // otherwise, we use standard input.
-    else 
-    {
-        // use an istringstream to read
-        std::string input {};
-        std::string line {};
-        while (std::getline(std::cin, line))
-        {
-            input += line += "\n";
-        }
-
-        static std::istringstream iss { input };
-        in = &iss;
-    }
-
-    return true;
-}
-
-bool add_byte_count(std::istream& in, std::stringstream& ss)
-{
-    int num_bytes { 0 };
-    char c {};
-
-    while (in.get(c))
-    {
-        ++num_bytes;
-    }
-
-    if (in.eof())
-    {
-        in.clear();
-        in.seekg(0, std::ios::beg);
-    }
-    else
-    {
-        return false;
-    }
-
-    ss << "\t" << num_bytes;
-    
-    return true;
-}
-
-bool add_line_count(std::istream& in, std::stringstream& ss)
-{
-    int num_lines { 0 };
-    std::string line {};
-    while (std::getline(in, line))
-    {
-        ++num_lines;
-    }
-
-    if (in.eof())
-    {
-        in.clear();
-        in.seekg(0, std::ios::beg);
-    }
-    else 
-    {
-        return false;
-    }
-
-    ss << "\t" << num_lines;
-    
-    return true;
-}
-
-bool add_word_count(std::istream& in, std::stringstream& ss)
-{
-    int num_words { 0 };
-    std::string word {};
-    while (in >> word)
-    {
-        ++num_words;
-    }
-
-    if (in.eof())
-    {
-        in.clear();
-        in.seekg(0, std::ios::beg);
-    }
-    else 
+    else if (!in.open_fd(STDIN_FILENO))
     {
+        std::cerr << "Error: standard input could not be opened.\n";
         return false;
     }
 
-    ss << "\t" << num_words;
-    
     return true;
 }
 
-bool add_char_count(std::istream& in, std::stringstream& ss)
+bool count_input(InputSource& in, Counts& counts)
 {
-    int num_chars { 0 };
-    char c {};
+    std::vector<uint8_t> buffer {};
+    const uint8_t* data {};
+    size_t size {};
+    CountState state {};
 
-    while (in.get(c))
+    do
     {
-        // presupposes utf-8 file encoding. In utf-8, characters are encoded in 
-        // 1~4 bytes, and continuation bytes of multibyte characters begin with 
-        // 10xxxxxx. We want to skip such continuations. 
-        // First we want to make sure they are not singlebyte characters. 
-        // 128 = 01000000, and anything above that is a multibyte character in utf-8.
-        // Then, extract the first two bits to see if they match the continuation 
-        // character. 
-        if ((unsigned char) c >= 128 && ((unsigned char) c & 0b11000000) == 0b10000000)
+        if (!in.read_span(READ_SIZE, buffer, data, size))
         {
-            continue;
+            return false;
         }
-        ++num_chars;
-    }
+        count_span(data, size, counts, state);
+    } while (size > 0);
 
-    if (in.eof())
-    {
-        in.clear();
-        in.seekg(0, std::ios::beg);
-    }
-    else
-    {
-        return false;
-    }
+    finish_counts(counts, state);
 
-    ss << "\t" << num_chars;
-    
     return true;
 }
 
 int main(int argc, char* argv[]) 
 {
     // program inputs 
-    std::istream* in {};
+    InputSource in {};
     std::string filepath {};
     Options opts {};
 
@@ -239,24 +147,31 @@ int main(int argc, char* argv[])
         opts.is_count_words = true;
     }
 
-    if (opts.is_count_bytes && !add_byte_count(*in, out)) 
+    Counts counts {};
+    if (!count_input(in, counts))
+    {
+        std::cerr << "Error: could not read file.\n";
+        return 1;
+    }
+
+    if (opts.is_count_bytes)
     {
-        std::cerr << "Error: could not read bytes of file.\n";
+        out << "\t" << counts.bytes;
     }
 
-    if (opts.is_count_lines && !add_line_count(*in, out))
+    if (opts.is_count_lines)
     {
-        std::cerr << "Error: could not read lines of file.\n";
+        out << "\t" << counts.lines;
     }
 
-    if (opts.is_count_words && !add_word_count(*in, out))
+    if (opts.is_count_words)
     {
-        std::cerr << "Error: could not read words of file.\n";
+        out << "\t" << counts.words;
     }
 
-    if (opts.is_count_chars && !add_char_count(*in, out))
+    if (opts.is_count_chars)
     {
-        std::cerr << "Error: could not read chars of file.\n";
+        out << "\t" << counts.chars;
     }
 
     out << "\t" << filepath;
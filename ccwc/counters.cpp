@@ -0,0 +1,94 @@
+#include <array>
+
+#include "counters.h"
+
+// whitespace as operator>> skips it in the classic locale.
+constexpr std::array<bool, 256> make_space_table()
+{
+    std::array<bool, 256> table {};
+    for (uint8_t c : { ' ', '\t', '\n', '\v', '\f', '\r' })
+    {
+        table[c] = true;
+    }
+    return table;
+}
+
+constexpr std::array<bool, 256> IS_SPACE { make_space_table() };
+
+// presupposes utf-8 file encoding. In utf-8, characters are encoded in 1~4 bytes, 
+// and continuation bytes of multibyte characters begin with 10xxxxxx. We want to 
+// skip such continuations. 
+inline bool starts_char(uint8_t c)
+{
+    return (c & 0b11000000) != 0b10000000;
+}
+
+uint64_t count_newlines(const uint8_t* data, size_t size)
+{
+    uint64_t lines { 0 };
+    for (size_t i = 0; i < size; ++i)
+    {
+        lines += data[i] == '\n';
+    }
+    return lines;
+}
+
+uint64_t count_words(const uint8_t* data, size_t size, bool& in_word)
+{
+    uint64_t words { 0 };
+    bool was_in_word { in_word };
+    for (size_t i = 0; i < size; ++i)
+    {
+        bool space { IS_SPACE[data[i]] };
+        words += !was_in_word && !space;
+        was_in_word = !space;
+    }
+    in_word = was_in_word;
+    return words;
+}
+
+uint64_t count_chars(const uint8_t* data, size_t size)
+{
+    uint64_t chars { 0 };
+    for (size_t i = 0; i < size; ++i)
+    {
+        chars += starts_char(data[i]);
+    }
+    return chars;
+}
+
+void count_span(const uint8_t* data, size_t size, Counts& counts, CountState& state)
+{
+    uint64_t lines { 0 };
+    uint64_t words { 0 };
+    uint64_t chars { 0 };
+    bool in_word { state.in_word };
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint8_t c { data[i] };
+        bool space { IS_SPACE[c] };
+        lines += c == '\n';
+        words += !in_word && !space;
+        in_word = !space;
+        chars += starts_char(c);
+    }
+
+    counts.bytes += size;
+    counts.lines += lines;
+    counts.words += words;
+    counts.chars += chars;
+    state.in_word = in_word;
+    if (size > 0)
+    {
+        state.last = data[size - 1];
+    }
+}
+
+void finish_counts(Counts& counts, const CountState& state)
+{
+    if (counts.bytes > 0 && state.last != '\n')
+    {
+        ++counts.lines;
+    }
+}
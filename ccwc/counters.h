@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counting over contiguous spans of bytes. count_span does every count in one
+// pass; the single counters do one count each, so they can be measured alone.
+
+struct Counts
+{
+    uint64_t bytes {};
+    uint64_t lines {};
+    uint64_t words {};
+    uint64_t chars {};
+};
+
+// carried from one span to the next, so counts don't depend on where spans end.
+struct CountState
+{
+    bool in_word {};
+    uint8_t last {};
+};
+
+// newline bytes in the span.
+uint64_t count_newlines(const uint8_t* data, size_t size);
+
+// runs of non-whitespace starting in the span. in_word says whether the span
+// starts inside a word and is updated to where it ends.
+uint64_t count_words(const uint8_t* data, size_t size, bool& in_word);
+
+// utf-8 characters starting in the span.
+uint64_t count_chars(const uint8_t* data, size_t size);
+
+void count_span(const uint8_t* data, size_t size, Counts& counts, CountState& state);
+
+// like getline, a last line without a newline still counts.
+void finish_counts(Counts& counts, const CountState& state);
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "corpus.h"
+
+constexpr size_t WRITE_CHUNK_SIZE { 1 << 20 };
+constexpr size_t LINE_WIDTH { 72 };
+
+constexpr const char* WORDS[] {
+    "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "for", "on", "are", "as", "with",
+    "his", "they", "at", "be", "this", "from", "have", "or", "by", "one", "had", "not", "but", "what",
+    "all", "were", "when", "we", "there", "can", "an", "your", "which", "their", "said", "if", "do",
+    "will", "each", "about", "how", "up", "out", "them", "then", "she", "many", "some", "so", "these",
+    "would", "other", "into", "has", "more", "her", "two", "like", "him", "see", "time", "could", "no",
+    "make", "than", "first", "been", "its", "who", "now", "people", "my", "made", "over", "did", "down",
+    "only", "way", "find", "use", "may", "water", "long", "little", "very", "after", "words", "called",
+    "just", "where", "most", "know", "river", "garden", "morning", "between", "country", "together",
+    "question", "remember", "something", "important", "government", "understand", "everything",
+};
+
+constexpr const char* LEVELS[] { "INFO", "INFO", "INFO", "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR" };
+constexpr const char* COMPONENTS[] { "http", "db", "cache", "auth", "scheduler", "worker" };
+constexpr const char* PATHS[] { "/api/v1/items", "/api/v1/users", "/api/v1/orders", "/health", "/static/app.js" };
+
+const std::vector<CorpusKind>& all_corpus_kinds()
+{
+    static const std::vector<CorpusKind> kinds {
+        CorpusKind::random, CorpusKind::skewed, CorpusKind::text, CorpusKind::logs, CorpusKind::binary
+    };
+    return kinds;
+}
+
+const char* corpus_name(CorpusKind kind)
+{
+    switch (kind)
+    {
+    case CorpusKind::random:
+        return "random";
+    case CorpusKind::skewed:
+        return "skewed";
+    case CorpusKind::text:
+        return "text";
+    case CorpusKind::logs:
+        return "logs";
+    case CorpusKind::binary:
+        return "binary";
+    }
+    return "unknown";
+}
+
+bool parse_corpus_kind(const std::string& name, CorpusKind& kind)
+{
+    for (CorpusKind candidate : all_corpus_kinds())
+    {
+        if (name == corpus_name(candidate))
+        {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+CorpusGenerator::CorpusGenerator(CorpusKind kind, uint64_t seed)
+    : m_kind { kind }
+    , m_state { (seed + static_cast<uint64_t>(kind)) * 0x9e3779b97f4a7c15ull | 1 }
+{
+}
+
+// xorshift64*, small and the same everywhere.
+uint64_t CorpusGenerator::next_random()
+{
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+    return m_state * 0x2545f4914f6cdd1dull;
+}
+
+void append_le(std::string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+void CorpusGenerator::generate_unit()
+{
+    m_pending.clear();
+    m_pending_pos = 0;
+
+    switch (m_kind)
+    {
+    case CorpusKind::random:
+    {
+        append_le(m_pending, next_random(), 8);
+        break;
+    }
+    case CorpusKind::skewed:
+    {
+        // about 4 bits per byte: a geometric run length picks the high bits, two
+        // random bits the low ones.
+        for (int i = 0; i < 8; ++i)
+        {
+            uint64_t value { next_random() };
+            int run { __builtin_ctzll(value | (uint64_t { 1 } << 62)) };
+            m_pending.push_back(static_cast<char>(std::min(255, run * 4 + static_cast<int>(value >> 62))));
+        }
+        break;
+    }
+    case CorpusKind::text:
+    {
+        // one sentence, wrapped at LINE_WIDTH. The column is kept in m_counter.
+        // Words are picked with weights 1 / (rank + 1).
+        static const std::array<double, std::size(WORDS)> cumulative { []()
+        {
+            std::array<double, std::size(WORDS)> weights {};
+            double total { 0.0 };
+            for (size_t i = 0; i < weights.size(); ++i)
+            {
+                total += 1.0 / (i + 1);
+                weights[i] = total;
+            }
+            for (double& weight : weights)
+            {
+                weight /= total;
+            }
+            return weights;
+        }() };
+
+        int word_count { 4 + static_cast<int>(next_random() % 16) };
+        for (int i = 0; i < word_count; ++i)
+        {
+            double pick { (next_random() >> 11) * 0x1.0p-53 };
+            size_t rank = std::lower_bound(cumulative.begin(), cumulative.end(), pick) - cumulative.begin();
+            std::string word { WORDS[std::min(rank, cumulative.size() - 1)] };
+            if (i == 0)
+            {
+                word[0] = static_cast<char>(word[0] - 'a' + 'A');
+            }
+            if (i == word_count - 1)
+            {
+                word += '.';
+            }
+            else if (next_random() % 10 == 0)
+            {
+                word += ',';
+            }
+
+            if (m_counter > 0 && m_counter + 1 + word.size() > LINE_WIDTH)
+            {
+                m_pending += '\n';
+                m_counter = 0;
+            }
+            else if (m_counter > 0)
+            {
+                m_pending += ' ';
+                ++m_counter;
+            }
+            m_pending += word;
+            m_counter += word.size();
+        }
+
+        // roughly one sentence in six ends a paragraph.
+        if (next_random() % 6 == 0)
+        {
+            m_pending += "\n\n";
+            m_counter = 0;
+        }
+        break;
+    }
+    case CorpusKind::logs:
+    {
+        // m_counter is the time in milliseconds since midnight.
+        m_counter += next_random() % 50;
+        uint64_t ms { m_counter % 1000 };
+        uint64_t seconds { m_counter / 1000 };
+        char line[256] {};
+        uint64_t choice { next_random() };
+        int length { std::snprintf(line, sizeof(line),
+            "2024-03-%02d %02d:%02d:%02d.%03d %-5s [%s] request id=%06d path=%s/%d status=%d latency=%dms\n",
+            static_cast<int>(1 + seconds / 86400 % 28), static_cast<int>(seconds / 3600 % 24),
+            static_cast<int>(seconds / 60 % 60), static_cast<int>(seconds % 60), static_cast<int>(ms),
+            LEVELS[choice % std::size(LEVELS)], COMPONENTS[(choice >> 8) % std::size(COMPONENTS)],
+            static_cast<int>((choice >> 16) % 1000000), PATHS[(choice >> 40) % std::size(PATHS)],
+            static_cast<int>((choice >> 44) % 500), (choice >> 53) % 20 == 0 ? 500 : 200,
+            static_cast<int>((choice >> 58) + 1)) };
+        m_pending.append(line, std::min<size_t>(length, sizeof(line) - 1));
+        break;
+    }
+    case CorpusKind::binary:
+    {
+        // a 32 byte record: sequence number, sensor id, a reading following a
+        // triangle wave with some noise, flags, a timestamp and a check value.
+        uint64_t sequence { m_counter++ };
+        uint64_t noise { next_random() };
+        uint32_t phase { static_cast<uint32_t>(sequence % 2000) };
+        int32_t reading { 20000 + static_cast<int32_t>(phase < 1000 ? phase : 2000 - phase) + static_cast<int32_t>(noise % 16) };
+        uint64_t timestamp { 1700000000000ull + sequence * 1000 + (noise >> 8) % 10 };
+        append_le(m_pending, sequence, 8);
+        append_le(m_pending, (noise >> 16) % 16, 4);
+        append_le(m_pending, static_cast<uint32_t>(reading), 4);
+        append_le(m_pending, (noise >> 24) % 64 == 0 ? 1 : 0, 2);
+        append_le(m_pending, 0, 2);
+        append_le(m_pending, timestamp, 8);
+        append_le(m_pending, static_cast<uint32_t>(sequence ^ timestamp ^ reading), 4);
+        break;
+    }
+    }
+}
+
+void CorpusGenerator::generate(uint8_t* out, size_t size)
+{
+    while (size > 0)
+    {
+        if (m_pending_pos == m_pending.size())
+        {
+            generate_unit();
+        }
+        size_t count { std::min(size, m_pending.size() - m_pending_pos) };
+        std::memcpy(out, m_pending.data() + m_pending_pos, count);
+        m_pending_pos += count;
+        out += count;
+        size -= count;
+    }
+}
+
+bool write_corpus(const std::string& path, CorpusKind kind, uint64_t size)
+{
+    std::ofstream file { path, std::ios::out | std::ios::binary | std::ios::trunc };
+    CorpusGenerator generator { kind };
+    std::vector<uint8_t> chunk(WRITE_CHUNK_SIZE);
+
+    for (uint64_t written = 0; written < size && file; written += chunk.size())
+    {
+        chunk.resize(std::min<uint64_t>(WRITE_CHUNK_SIZE, size - written));
+        generator.generate(chunk.data(), chunk.size());
+        file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+    file.close();
+
+    return !file.fail();
+}
+
+bool parse_size(const std::string& text, uint64_t& size)
+{
+    char* end {};
+    size = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || text[0] == '-')
+    {
+        return false;
+    }
+
+    switch (*end)
+    {
+    case 'G':
+        size <<= 10;
+        [[fallthrough]];
+    case 'M':
+        size <<= 10;
+        [[fallthrough]];
+    case 'K':
+        size <<= 10;
+        ++end;
+        break;
+    default:
+        break;
+    }
+
+    return *end == '\0';
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic benchmark corpora. The same kind, size and seed always produce
+// the same bytes, so results from different versions measure the same input.
+//
+//   random: uniformly random bytes, which don't compress at all
+//   skewed: bytes with a steep geometric distribution and no structure beyond it
+//   text:   English-like prose from a fixed vocabulary with Zipf word frequencies
+//   logs:   repetitive log lines with increasing timestamps and a few varying fields
+//   binary: fixed size little endian records with counters and slowly moving values
+
+enum class CorpusKind
+{
+    random,
+    skewed,
+    text,
+    logs,
+    binary,
+};
+
+const std::vector<CorpusKind>& all_corpus_kinds();
+const char* corpus_name(CorpusKind kind);
+bool parse_corpus_kind(const std::string& name, CorpusKind& kind);
+
+// produces a corpus in pieces of any size. Consecutive calls continue where the
+// last one stopped, so a large corpus never has to be held in memory at once.
+class CorpusGenerator
+{
+private:
+    CorpusKind m_kind {};
+    uint64_t m_state {};
+    uint64_t m_counter {};
+    std::string m_pending {}; // generated but not yet handed out
+    size_t m_pending_pos {};
+
+    uint64_t next_random();
+    void generate_unit();
+
+public:
+    explicit CorpusGenerator(CorpusKind kind, uint64_t seed = 1);
+
+    void generate(uint8_t* out, size_t size);
+};
+
+// writes size bytes of the corpus to path, replacing the file.
+bool write_corpus(const std::string& path, CorpusKind kind, uint64_t size);
+
+// parses a byte count with an optional binary K, M or G suffix, like 5G.
+bool parse_size(const std::string& text, uint64_t& size);
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "input_source.h"
+
+constexpr size_t READ_CHUNK_SIZE { 1 << 20 };
+
+InputSource::~InputSource()
+{
+    if (m_map)
+    {
+        munmap(m_map, m_map_size);
+    }
+    if (m_owns_fd)
+    {
+        close(m_fd);
+    }
+}
+
+bool InputSource::open(const std::string& path)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+    m_owns_fd = true;
+    return init();
+}
+
+bool InputSource::open_fd(int fd)
+{
+    m_fd = fd;
+    return init();
+}
+
+bool InputSource::init()
+{
+    struct stat info {};
+    if (fstat(m_fd, &info) != 0)
+    {
+        return false;
+    }
+
+    // only regular files have a fixed size that can be mapped. Anything else is read.
+    if (!S_ISREG(info.st_mode))
+    {
+        return true;
+    }
+
+    // the mapping starts at the current offset's page, so a redirected standard
+    // input that was partly read keeps its position.
+    off_t offset { lseek(m_fd, 0, SEEK_CUR) };
+    if (offset < 0 || offset > info.st_size)
+    {
+        return true;
+    }
+
+    // where size_t is 32 bits, files over 2 GiB don't fit the address space and are read.
+    if (static_cast<uint64_t>(info.st_size - offset) > SIZE_MAX / 2)
+    {
+        return true;
+    }
+    m_size = info.st_size - offset;
+    m_mapped = true;
+    if (m_size == 0)
+    {
+        return true;
+    }
+
+    // mappings start on a page boundary, the data starts at the offset within it.
+    off_t page_offset { offset & ~static_cast<off_t>(sysconf(_SC_PAGESIZE) - 1) };
+    m_map_size = m_size + (offset - page_offset);
+    m_map = mmap(nullptr, m_map_size, PROT_READ, MAP_PRIVATE, m_fd, page_offset);
+    if (m_map == MAP_FAILED)
+    {
+        m_map = nullptr;
+        m_mapped = false;
+        m_size = 0;
+        return true;
+    }
+    m_data = static_cast<const uint8_t*>(m_map) + (offset - page_offset);
+
+    // the input is read front to back, so the kernel can read ahead aggressively.
+    // Huge pages cut the TLB misses of walking a large mapping where supported.
+    madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(m_map, m_map_size, MADV_HUGEPAGE);
+#endif
+
+    return true;
+}
+
+bool InputSource::read(uint8_t* out, size_t size, size_t& read)
+{
+    read = 0;
+    if (m_mapped)
+    {
+        // an empty file has nothing mapped to copy from.
+        read = std::min(size, m_size - m_pos);
+        if (read > 0)
+        {
+            std::memcpy(out, m_data + m_pos, read);
+        }
+        m_pos += read;
+        return true;
+    }
+
+    // pipes return what they have, so keep reading until the request is filled.
+    while (read < size)
+    {
+        ssize_t count { ::read(m_fd, out + read, size - read) };
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            return false;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        read += count;
+    }
+
+    return true;
+}
+
+bool InputSource::read_span(size_t size, std::vector<uint8_t>& buffer, const uint8_t*& data, size_t& read)
+{
+    if (m_mapped)
+    {
+        data = m_data + m_pos;
+        read = std::min(size, m_size - m_pos);
+        m_pos += read;
+
+        // spans are handed out ahead of their use, so the disk can already start 
+        // on them while earlier ones are worked on.
+        if (read > 0)
+        {
+            uintptr_t page_mask { static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1 };
+            uintptr_t start { reinterpret_cast<uintptr_t>(data) & ~page_mask };
+            madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(data) + read - start, MADV_WILLNEED);
+        }
+        return true;
+    }
+
+    // the buffer grows with the data that arrives, so a short input doesn't pay 
+    // for zeroing a buffer sized for a large request.
+    read = 0;
+    while (read < size)
+    {
+        size_t chunk { std::min(size - read, READ_CHUNK_SIZE) };
+        size_t count {};
+        buffer.resize(read + chunk);
+        if (!this->read(buffer.data() + read, chunk, count))
+        {
+            return false;
+        }
+        read += count;
+        if (count < chunk)
+        {
+            break;
+        }
+    }
+    buffer.resize(read);
+    data = buffer.data();
+
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Input read as contiguous spans of bytes. Regular files are memory mapped, so
+// their contents can be used in place without copying through stream buffers.
+// Pipes and other inputs that can't be mapped fall back to large read() calls.
+class InputSource
+{
+private:
+    int m_fd { -1 };
+    bool m_owns_fd {};
+    bool m_mapped {};
+    void* m_map {};
+    size_t m_map_size {};
+    const uint8_t* m_data {}; // whole input, when mapped
+    size_t m_size {};
+    size_t m_pos {};
+
+    bool init();
+
+public:
+    InputSource() = default;
+    InputSource(const InputSource&) = delete;
+    InputSource& operator=(const InputSource&) = delete;
+    ~InputSource();
+
+    bool open(const std::string& path);
+    bool open_fd(int fd); // the descriptor is not closed by the source
+
+    // with a mapped input the whole contents are available at once, which also
+    // allows random access.
+    bool is_mapped() const { return m_mapped; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // the next size bytes, or fewer at the end of the input. Points into the
+    // mapping when there is one, otherwise the bytes are read into buffer.
+    bool read_span(size_t size, std::vector<uint8_t>& buffer, const uint8_t*& data, size_t& read);
+
+    // copies the next size bytes, or fewer at the end of the input, to out.
+    bool read(uint8_t* out, size_t size, size_t& read);
+};
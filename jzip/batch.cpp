@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+
+#include "input_source.h"
+#include "thread_pool.h"
+#include "batch.h"
+
+// small files are grouped until a group holds this many bytes or files.
+constexpr uint64_t GROUP_SIZE { 4 << 20 };
+constexpr size_t GROUP_FILE_COUNT { 64 };
+
+// compresses or decompresses a whole small file on the calling worker, with the
+// contexts and buffers of the worker.
+bool process_small_file(const BatchFile& file, const CompressOptions& compress_options, const DecompressOptions& decompress_options, 
+                        std::unique_ptr<CompressContext>& compressor, std::unique_ptr<DecompressContext>& decompressor, 
+                        std::vector<uint8_t>& input_buffer, std::vector<uint8_t>& output)
+{
+    InputSource input {};
+    const uint8_t* data {};
+    size_t size {};
+    if (!input.open(file.input_path) || !input.read_span(SIZE_MAX, input_buffer, data, size))
+    {
+        std::cerr << "Error: file " << file.input_path << " could not be read.\n";
+        return false;
+    }
+
+    size_t output_size {};
+    bool ok {};
+    if (file.compress)
+    {
+        if (!compressor)
+        {
+            compressor = std::make_unique<CompressContext>(compress_options);
+        }
+        output.resize(std::max(output.size(), compress_bound(size, compress_options.block_size)));
+        ok = compressor->compress(data, size, output.data(), output.size(), output_size);
+    }
+    else
+    {
+        if (!decompressor)
+        {
+            decompressor = std::make_unique<DecompressContext>(decompress_options.dictionary);
+        }
+        uint64_t decompressed_size {};
+        ok = decompressor->decompressed_size(data, size, decompressed_size);
+        if (ok)
+        {
+            output.resize(std::max<size_t>(output.size(), decompressed_size));
+            ok = decompressor->decompress(data, size, output.data(), output.size(), output_size);
+        }
+    }
+    if (!ok)
+    {
+        return false;
+    }
+
+    std::ofstream outfile { file.output_path, std::ios::out | std::ios::binary | std::ios::trunc };
+    outfile.write(reinterpret_cast<const char*>(output.data()), output_size);
+    outfile.close();
+    if (outfile.fail())
+    {
+        std::cerr << "Error: failed to write " << file.output_path << ".\n";
+        return false;
+    }
+
+    return true;
+}
+
+// the contexts and buffers live as long as the worker, so after the first few 
+// files nothing is allocated but the streams. Buffers that grew past what a file 
+// of a block needs, like one a pipe was read into whole, are given back after 
+// the file instead of being held by the worker until the batch ends.
+bool process_small_file(const BatchFile& file, const CompressOptions& compress_options, const DecompressOptions& decompress_options)
+{
+    thread_local std::unique_ptr<CompressContext> compressor {};
+    thread_local std::unique_ptr<DecompressContext> decompressor {};
+    thread_local std::vector<uint8_t> input_buffer {};
+    thread_local std::vector<uint8_t> output {};
+
+    bool ok { process_small_file(file, compress_options, decompress_options, compressor, decompressor, input_buffer, output) };
+
+    size_t buffer_limit { std::max<size_t>(GROUP_SIZE, compress_bound(compress_options.block_size, compress_options.block_size)) };
+    if (input_buffer.capacity() > buffer_limit)
+    {
+        input_buffer = {};
+    }
+    if (output.capacity() > buffer_limit)
+    {
+        output = {};
+    }
+
+    return ok;
+}
+
+// a large file goes through the same path as a file on its own, with its blocks
+// spread over the shared pool.
+bool process_large_file(const BatchFile& file, const CompressOptions& compress_options, const DecompressOptions& decompress_options, ThreadPool& pool)
+{
+    InputSource input {};
+    if (!input.open(file.input_path))
+    {
+        std::cerr << "Error: file " << file.input_path << " could not be opened.\n";
+        return false;
+    }
+
+    if (!file.compress)
+    {
+        return decompress_file(input, file.output_path, decompress_options, pool);
+    }
+
+    std::ofstream outfile { file.output_path, std::ios::out | std::ios::binary | std::ios::trunc };
+    bool ok { compress_file(input, outfile, compress_options, pool) };
+    outfile.close();
+    if (ok && outfile.fail())
+    {
+        std::cerr << "Error: failed to write " << file.output_path << ".\n";
+        return false;
+    }
+
+    return ok;
+}
+
+// files that compress or decompress to at most a block are small. The size of 
+// a compressed file's data is read from its block index, as a few bytes may 
+// expand to gigabytes. Fails when that can't be read, after reporting why.
+bool is_small_file(const BatchFile& file, uint64_t block_size, DecompressContext& sizer, bool& small, uint64_t& size)
+{
+    // a file that can't be looked at is left to fail in a group.
+    struct stat info {};
+    small = true;
+    size = 0;
+    if (stat(file.input_path.c_str(), &info) != 0)
+    {
+        return true;
+    }
+
+    size = info.st_size;
+    small = size <= block_size;
+    if (file.compress || !small)
+    {
+        return true;
+    }
+
+    InputSource input {};
+    small = input.open(file.input_path) && input.is_mapped();
+    if (!small)
+    {
+        return true;
+    }
+
+    uint64_t data_size {};
+    if (!sizer.decompressed_size(input.data(), input.size(), data_size))
+    {
+        return false;
+    }
+    small = data_size <= block_size;
+    size = std::max(size, data_size);
+    return true;
+}
+
+bool report_result(const BatchFile& file, bool ok)
+{
+    if (!ok)
+    {
+        std::cerr << "Error: failed to " << (file.compress ? "compress " : "decompress ") << file.input_path << ".\n";
+        std::error_code error {};
+        std::filesystem::remove(file.output_path, error);
+    }
+    return ok;
+}
+
+bool process_batch(const std::vector<BatchFile>& files, const CompressOptions& compress_options, const DecompressOptions& decompress_options)
+{
+    ThreadPool pool { compress_options.threads > 0 ? compress_options.threads : default_thread_count() };
+    std::vector<std::future<bool>> groups {};
+    std::vector<const BatchFile*> large_files {};
+
+    // the small files are queued in groups first, so the workers start on them
+    // right away. A file that can't be looked at is left to fail in its group.
+    std::vector<const BatchFile*> group {};
+    uint64_t group_size { 0 };
+    auto submit_group { [&]()
+    {
+        groups.push_back(pool.submit([&, group = group]()
+        {
+            bool ok { true };
+            for (const BatchFile* file : group)
+            {
+                ok = report_result(*file, process_small_file(*file, compress_options, decompress_options)) && ok;
+            }
+            return ok;
+        }));
+        group.clear();
+        group_size = 0;
+    } };
+
+    DecompressContext sizer { decompress_options.dictionary };
+    bool ok { true };
+    for (const BatchFile& file : files)
+    {
+        bool small {};
+        uint64_t size {};
+        if (!is_small_file(file, compress_options.block_size, sizer, small, size))
+        {
+            ok = report_result(file, false) && ok;
+            continue;
+        }
+        if (!small)
+        {
+            large_files.push_back(&file);
+            continue;
+        }
+
+        group.push_back(&file);
+        group_size += size;
+        if (group_size >= GROUP_SIZE || group.size() >= GROUP_FILE_COUNT)
+        {
+            submit_group();
+        }
+    }
+    if (!group.empty())
+    {
+        submit_group();
+    }
+
+    // this thread isn't a worker, so it can wait on the blocks of large files.
+    for (const BatchFile* file : large_files)
+    {
+        ok = report_result(*file, process_large_file(*file, compress_options, decompress_options, pool)) && ok;
+    }
+    for (std::future<bool>& result : groups)
+    {
+        ok = result.get() && ok;
+    }
+
+    return ok;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "compress.h"
+#include "decompress.h"
+
+// Many files compressed or decompressed at once on one thread pool. Files of up
+// to a block, both compressed and not, are grouped, and each group is handled by
+// one worker with the buffers and code tables it kept from its last file. Larger files are split
+// into blocks across all workers, as they would be on their own, while the small
+// groups fill in around them.
+struct BatchFile
+{
+    std::string input_path {};
+    std::string output_path {};
+    bool compress {};
+};
+
+// every file is attempted and errors are reported per file. Fails if any file
+// failed, removing what was written of its output.
+bool process_batch(const std::vector<BatchFile>& files, const CompressOptions& compress_options, const DecompressOptions& decompress_options);
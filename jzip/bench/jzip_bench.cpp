@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "compress.h"
+#include "corpus.h"
+#include "decompress.h"
+#include "histogram.h"
+#include "input_source.h"
+#include "lz77.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+const char* PROGRAM_NAME;
+
+struct BenchConfig
+{
+    std::string name {};
+    CompressOptions options {};
+};
+
+struct BenchOptions
+{
+    std::vector<uint64_t> sizes { 1 << 10, 1 << 20, 64 << 20, 1 << 30 };
+    std::vector<CorpusKind> kinds { all_corpus_kinds() };
+    std::vector<BenchConfig> configs {};
+    int repeat { 3 };
+    int threads {};
+    std::string work_dir { "bench-corpus" };
+    std::string csv_path {};
+    std::string json_path {};
+};
+
+// one corpus compressed with one configuration. Times are the best of the
+// repeats, peak memory the largest.
+struct BenchResult
+{
+    std::string corpus {};
+    uint64_t size {};
+    std::string config {};
+    uint64_t compressed_size {};
+    double compress_seconds {};
+    double decompress_seconds {};
+    long compress_rss_kb {};
+    long decompress_rss_kb {};
+    double map_seconds {};       // first pass over the mapped corpus
+    double histogram_seconds {}; // counting the bytes of the whole corpus
+    double parse_seconds {};     // LZ77 parse of every block, at LZ levels only
+    // against the static two-pass huffman config on the same corpus, 0 when it 
+    // wasn't run. Above 1 is a better ratio or more MB/s.
+    double ratio_vs_huffman {};
+    double compress_speed_vs_huffman {};
+    double decompress_speed_vs_huffman {};
+    bool verified {};
+};
+
+const std::vector<BenchConfig>& all_configs()
+{
+    static const std::vector<BenchConfig> configs { []()
+    {
+        std::vector<BenchConfig> list(6);
+        list[0].name = "huffman";
+        list[1].name = "adaptive";
+        list[1].options.adaptive = true;
+        list[2].name = "tans";
+        list[2].options.coder = EntropyCoder::tans;
+        list[3].name = "order1";
+        list[3].options.context_model = true;
+        list[4].name = "lz1";
+        list[4].options.level = 1;
+        list[5].name = "lz6";
+        list[5].options.level = 6;
+        return list;
+    }() };
+    return configs;
+}
+
+void print_usage(std::ostream& stream)
+{
+    stream << "Measures jzip on generated corpora and writes the results as CSV or JSON.\n\n"
+           << "Usage: " << PROGRAM_NAME << " <-h> <-j threads> <--sizes list> <--corpora list> <--configs list> "
+           << "<--repeat n> <--work-dir dir> <--csv path> <--json path>\n"
+           << "\t-h display this usage information.\n"
+           << "\t-j number of threads jzip uses (default: one per core).\n"
+           << "\t--sizes comma separated corpus sizes with an optional K, M or G suffix (default 1K,1M,64M,1G).\n"
+           << "\t--corpora comma separated corpus kinds: random, skewed, text, logs, binary (default all).\n"
+           << "\t--configs comma separated configurations: huffman, adaptive, tans, order1, lz1, lz6 (default all).\n"
+           << "\t--repeat run every measurement this many times and keep the best (default 3).\n"
+           << "\t--work-dir directory for the corpora and their compressed copies (default bench-corpus).\n"
+           << "\t--csv write the results as CSV to the given path, - for standard output.\n"
+           << "\t--json write the results as JSON to the given path, - for standard output.\n"
+           << "\t   Without --csv or --json, CSV goes to standard output.\n";
+}
+
+std::vector<std::string> split_list(const std::string& text)
+{
+    std::vector<std::string> items {};
+    std::stringstream stream { text };
+    std::string item {};
+    while (std::getline(stream, item, ','))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+bool process_arguments(BenchOptions& opts, int argc, char* argv[])
+{
+    PROGRAM_NAME = argv[0];
+    int opt {};
+    const char* opt_flags { "hj:" };
+    const option long_opts[] {
+        { "sizes", required_argument, nullptr, 's' },
+        { "corpora", required_argument, nullptr, 'k' },
+        { "configs", required_argument, nullptr, 'g' },
+        { "repeat", required_argument, nullptr, 'r' },
+        { "work-dir", required_argument, nullptr, 'W' },
+        { "csv", required_argument, nullptr, 'C' },
+        { "json", required_argument, nullptr, 'J' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    opts.configs = all_configs();
+    while ((opt = getopt_long(argc, argv, opt_flags, long_opts, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            print_usage(std::cout);
+            std::exit(0);
+        case 'j':
+            opts.threads = std::atoi(optarg);
+            if (opts.threads < 1)
+            {
+                std::cerr << "Error: thread count must be at least 1.\n";
+                return false;
+            }
+            break;
+        case 's':
+            opts.sizes.clear();
+            for (const std::string& item : split_list(optarg))
+            {
+                uint64_t size {};
+                if (!parse_size(item, size) || size == 0)
+                {
+                    std::cerr << "Error: invalid corpus size " << item << ".\n";
+                    return false;
+                }
+                opts.sizes.push_back(size);
+            }
+            break;
+        case 'k':
+            opts.kinds.clear();
+            for (const std::string& item : split_list(optarg))
+            {
+                CorpusKind kind {};
+                if (!parse_corpus_kind(item, kind))
+                {
+                    std::cerr << "Error: unknown corpus " << item << ".\n";
+                    return false;
+                }
+                opts.kinds.push_back(kind);
+            }
+            break;
+        case 'g':
+            opts.configs.clear();
+            for (const std::string& item : split_list(optarg))
+            {
+                auto config { std::find_if(all_configs().begin(), all_configs().end(),
+                    [&](const BenchConfig& config) { return config.name == item; }) };
+                if (config == all_configs().end())
+                {
+                    std::cerr << "Error: unknown configuration " << item << ".\n";
+                    return false;
+                }
+                opts.configs.push_back(*config);
+            }
+            break;
+        case 'r':
+            opts.repeat = std::atoi(optarg);
+            if (opts.repeat < 1)
+            {
+                std::cerr << "Error: repeat count must be at least 1.\n";
+                return false;
+            }
+            break;
+        case 'W':
+            opts.work_dir = optarg;
+            break;
+        case 'C':
+            opts.csv_path = optarg;
+            break;
+        case 'J':
+            opts.json_path = optarg;
+            break;
+        case '?':
+            print_usage(std::cerr);
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    if (opts.csv_path.empty() && opts.json_path.empty())
+    {
+        opts.csv_path = "-";
+    }
+
+    return true;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// runs task in a child process, so its peak memory can be measured on its own.
+bool run_measured(const std::function<bool()>& task, double& seconds, long& peak_rss_kb)
+{
+    auto start { std::chrono::steady_clock::now() };
+    pid_t pid { fork() };
+    if (pid < 0)
+    {
+        return false;
+    }
+    if (pid == 0)
+    {
+        _exit(task() ? 0 : 1);
+    }
+
+    int status {};
+    rusage usage {};
+    if (wait4(pid, &status, 0, &usage) != pid)
+    {
+        return false;
+    }
+    seconds = seconds_since(start);
+    peak_rss_kb = usage.ru_maxrss;
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool compress_path(const std::string& in_path, const std::string& out_path, const CompressOptions& options)
+{
+    InputSource input {};
+    std::ofstream output { out_path, std::ios::out | std::ios::binary | std::ios::trunc };
+    bool ok = input.open(in_path) && compress_file(input, output, options);
+    output.close();
+    return ok && !output.fail();
+}
+
+bool decompress_path(const std::string& in_path, const std::string& out_path, const DecompressOptions& options)
+{
+    InputSource input {};
+    return input.open(in_path) && decompress_file(input, out_path, options);
+}
+
+bool same_contents(const std::string& a_path, const std::string& b_path)
+{
+    InputSource a {};
+    InputSource b {};
+    return a.open(a_path) && b.open(b_path) && a.is_mapped() && b.is_mapped() && a.size() == b.size()
+        && (a.size() == 0 || std::memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+// times the phases that can be run on their own: touching the mapped corpus,
+// counting its bytes, and the LZ77 parse that comes before entropy coding.
+bool measure_phases(const std::string& path, const BenchOptions& opts, BenchResult& result, const CompressOptions& options)
+{
+    InputSource input {};
+    if (!input.open(path) || !input.is_mapped())
+    {
+        return false;
+    }
+    const uint8_t* data { input.data() };
+    size_t size { input.size() };
+
+    result.map_seconds = result.histogram_seconds = result.parse_seconds = 1e30;
+    for (int run = 0; run < opts.repeat; ++run)
+    {
+        auto start { std::chrono::steady_clock::now() };
+        uint64_t sum { 0 };
+        for (size_t i = 0; i < size; i += 64)
+        {
+            sum += data[i];
+        }
+        result.map_seconds = std::min(result.map_seconds, seconds_since(start));
+        asm volatile("" : : "r"(sum));
+
+        start = std::chrono::steady_clock::now();
+        ByteHistogram histogram {};
+        count_bytes(data, size, histogram);
+        result.histogram_seconds = std::min(result.histogram_seconds, seconds_since(start));
+
+        if (options.level > 0)
+        {
+            MatchFinder finder {};
+            LzStreams streams {};
+            start = std::chrono::steady_clock::now();
+            for (size_t offset = 0; offset < size; offset += options.block_size)
+            {
+                finder.parse(data + offset, std::min(options.block_size, size - offset), options.level, options.window_bits, streams);
+            }
+            result.parse_seconds = std::min(result.parse_seconds, seconds_since(start));
+        }
+    }
+    if (options.level == 0)
+    {
+        result.parse_seconds = 0.0;
+    }
+
+    return true;
+}
+
+bool run_config(const std::string& corpus_path, const BenchConfig& config, const BenchOptions& opts, BenchResult& result)
+{
+    std::string compressed_path { corpus_path + "." + config.name + ".jzip" };
+    std::string decompressed_path { corpus_path + "." + config.name + ".out" };
+    CompressOptions compress_options { config.options };
+    DecompressOptions decompress_options {};
+    compress_options.threads = opts.threads;
+    decompress_options.threads = opts.threads;
+
+    result.config = config.name;
+    result.compress_seconds = result.decompress_seconds = 1e30;
+    bool ok { measure_phases(corpus_path, opts, result, compress_options) };
+
+    for (int run = 0; ok && run < opts.repeat; ++run)
+    {
+        double seconds {};
+        long peak_rss_kb {};
+        ok = run_measured([&]() { return compress_path(corpus_path, compressed_path, compress_options); }, seconds, peak_rss_kb);
+        result.compress_seconds = std::min(result.compress_seconds, seconds);
+        result.compress_rss_kb = std::max(result.compress_rss_kb, peak_rss_kb);
+
+        ok = ok && run_measured([&]() { return decompress_path(compressed_path, decompressed_path, decompress_options); }, seconds, peak_rss_kb);
+        result.decompress_seconds = std::min(result.decompress_seconds, seconds);
+        result.decompress_rss_kb = std::max(result.decompress_rss_kb, peak_rss_kb);
+    }
+
+    result.compressed_size = ok ? std::filesystem::file_size(compressed_path) : 0;
+    result.verified = ok && same_contents(corpus_path, decompressed_path);
+
+    std::error_code error {};
+    std::filesystem::remove(compressed_path, error);
+    std::filesystem::remove(decompressed_path, error);
+
+    return ok;
+}
+
+double megabytes_per_second(uint64_t size, double seconds)
+{
+    return seconds > 0.0 ? size / seconds / 1e6 : 0.0;
+}
+
+double ratio(const BenchResult& result)
+{
+    return result.compressed_size > 0 ? static_cast<double>(result.size) / result.compressed_size : 0.0;
+}
+
+void compare_with_huffman(std::vector<BenchResult>::iterator first, std::vector<BenchResult>::iterator last)
+{
+    auto baseline { std::find_if(first, last, [](const BenchResult& result) { return result.config == "huffman"; }) };
+    if (baseline == last)
+    {
+        return;
+    }
+
+    for (auto result = first; result != last; ++result)
+    {
+        result->ratio_vs_huffman = ratio(*baseline) > 0.0 ? ratio(*result) / ratio(*baseline) : 0.0;
+        result->compress_speed_vs_huffman = result->compress_seconds > 0.0 ? baseline->compress_seconds / result->compress_seconds : 0.0;
+        result->decompress_speed_vs_huffman = result->decompress_seconds > 0.0 ? baseline->decompress_seconds / result->decompress_seconds : 0.0;
+    }
+}
+
+void write_csv(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "version,corpus,size,config,compressed_size,ratio,compress_mb_s,decompress_mb_s,"
+        << "compress_seconds,decompress_seconds,compress_peak_rss_kb,decompress_peak_rss_kb,"
+        << "map_seconds,histogram_seconds,parse_seconds,"
+        << "ratio_vs_huffman,compress_speed_vs_huffman,decompress_speed_vs_huffman,verified\n";
+    for (const BenchResult& result : results)
+    {
+        out << BENCH_VERSION << ',' << result.corpus << ',' << result.size << ',' << result.config << ','
+            << result.compressed_size << ',' << ratio(result) << ','
+            << megabytes_per_second(result.size, result.compress_seconds) << ','
+            << megabytes_per_second(result.size, result.decompress_seconds) << ','
+            << result.compress_seconds << ',' << result.decompress_seconds << ','
+            << result.compress_rss_kb << ',' << result.decompress_rss_kb << ','
+            << result.map_seconds << ',' << result.histogram_seconds << ',' << result.parse_seconds << ','
+            << result.ratio_vs_huffman << ',' << result.compress_speed_vs_huffman << ',' << result.decompress_speed_vs_huffman << ','
+            << (result.verified ? "true" : "false") << '\n';
+    }
+}
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << "{\n  \"version\": \"" << BENCH_VERSION << "\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& result { results[i] };
+        out << (i > 0 ? "," : "") << "\n    { "
+            << "\"corpus\": \"" << result.corpus << "\", \"size\": " << result.size
+            << ", \"config\": \"" << result.config << "\", \"compressed_size\": " << result.compressed_size
+            << ", \"ratio\": " << ratio(result)
+            << ", \"compress_mb_s\": " << megabytes_per_second(result.size, result.compress_seconds)
+            << ", \"decompress_mb_s\": " << megabytes_per_second(result.size, result.decompress_seconds)
+            << ", \"compress_seconds\": " << result.compress_seconds
+            << ", \"decompress_seconds\": " << result.decompress_seconds
+            << ", \"compress_peak_rss_kb\": " << result.compress_rss_kb
+            << ", \"decompress_peak_rss_kb\": " << result.decompress_rss_kb
+            << ", \"phases\": { \"map_seconds\": " << result.map_seconds
+            << ", \"histogram_seconds\": " << result.histogram_seconds
+            << ", \"parse_seconds\": " << result.parse_seconds << " }"
+            << ", \"vs_huffman\": { \"ratio\": " << result.ratio_vs_huffman
+            << ", \"compress_speed\": " << result.compress_speed_vs_huffman
+            << ", \"decompress_speed\": " << result.decompress_speed_vs_huffman << " }"
+            << ", \"verified\": " << (result.verified ? "true" : "false") << " }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool write_results(const std::string& path, const std::vector<BenchResult>& results, void (*write)(std::ostream&, const std::vector<BenchResult>&))
+{
+    if (path.empty())
+    {
+        return true;
+    }
+    if (path == "-")
+    {
+        write(std::cout, results);
+        return static_cast<bool>(std::cout);
+    }
+
+    std::ofstream file { path };
+    write(file, results);
+    file.close();
+    if (file.fail())
+    {
+        std::cerr << "Error: failed to write " << path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions opts {};
+    if (!process_arguments(opts, argc, argv))
+    {
+        return 1;
+    }
+
+    std::error_code error {};
+    std::filesystem::create_directories(opts.work_dir, error);
+    if (error)
+    {
+        std::cerr << "Error: could not create " << opts.work_dir << ".\n";
+        return 1;
+    }
+
+    std::vector<BenchResult> results {};
+    bool ok { true };
+    for (CorpusKind kind : opts.kinds)
+    {
+        for (uint64_t size : opts.sizes)
+        {
+            std::string corpus_path { opts.work_dir + "/" + corpus_name(kind) + "-" + std::to_string(size) };
+            if (!write_corpus(corpus_path, kind, size))
+            {
+                std::cerr << "Error: failed to write corpus " << corpus_path << ".\n";
+                return 1;
+            }
+
+            size_t first_result { results.size() };
+            for (const BenchConfig& config : opts.configs)
+            {
+                BenchResult result {};
+                result.corpus = corpus_name(kind);
+                result.size = size;
+                if (!run_config(corpus_path, config, opts, result) || !result.verified)
+                {
+                    std::cerr << "Error: " << config.name << " failed on " << corpus_path << ".\n";
+                    ok = false;
+                }
+                std::cerr << result.corpus << ' ' << size << ' ' << config.name << ": ratio " << ratio(result)
+                          << ", " << megabytes_per_second(size, result.compress_seconds) << " MB/s compress, "
+                          << megabytes_per_second(size, result.decompress_seconds) << " MB/s decompress\n";
+                results.push_back(result);
+            }
+
+            // every config against the static two-pass path, adaptive Huffman in particular.
+            compare_with_huffman(results.begin() + first_result, results.end());
+            for (auto result = results.begin() + first_result; result != results.end(); ++result)
+            {
+                if (result->config != "huffman" && result->ratio_vs_huffman > 0.0)
+                {
+                    std::cerr << "  " << result->config << " vs huffman: " << result->ratio_vs_huffman << "x ratio, "
+                              << result->compress_speed_vs_huffman << "x compress MB/s, "
+                              << result->decompress_speed_vs_huffman << "x decompress MB/s\n";
+                }
+            }
+
+            std::filesystem::remove(corpus_path, error);
+        }
+    }
+
+    ok = write_results(opts.csv_path, results, write_csv) && ok;
+    ok = write_results(opts.json_path, results, write_json) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "corpus.h"
+
+// Streams a benchmark corpus to standard output, or checks that standard input
+// is exactly that corpus. Neither keeps more than a chunk in memory, so inputs
+// far beyond 4 GiB can be round tripped through jzip without touching the disk:
+//
+//   jzip_corpus --size 5G | jzip | jzip -d | jzip_corpus --size 5G --verify
+
+constexpr size_t CHUNK_SIZE { 1 << 20 };
+
+const char* PROGRAM_NAME;
+
+struct CorpusOptions
+{
+    CorpusKind kind { CorpusKind::text };
+    uint64_t size { 1 << 20 };
+    uint64_t seed { 1 };
+    bool verify {};
+};
+
+void print_usage(std::ostream& stream)
+{
+    stream << "jzip_corpus writes a generated corpus to standard output, or verifies one read from standard input.\n\n"
+           << "Usage: " << PROGRAM_NAME << " <-h> <--corpus kind> <--size bytes> <--seed n> <--verify>\n"
+           << "\t-h display this usage information.\n"
+           << "\t--corpus random, skewed, text (default), logs or binary.\n"
+           << "\t--size corpus size with an optional K, M or G suffix (default 1M).\n"
+           << "\t--seed seed of the generator (default 1).\n"
+           << "\t--verify compare standard input with the corpus instead of writing it.\n";
+}
+
+bool process_arguments(CorpusOptions& opts, int argc, char* argv[])
+{
+    PROGRAM_NAME = argv[0];
+    int opt {};
+    const char* opt_flags { "h" };
+    const option long_opts[] {
+        { "corpus", required_argument, nullptr, 'k' },
+        { "size", required_argument, nullptr, 's' },
+        { "seed", required_argument, nullptr, 'S' },
+        { "verify", no_argument, nullptr, 'V' },
+        { nullptr, 0, nullptr, 0 },
+    };
+
+    while ((opt = getopt_long(argc, argv, opt_flags, long_opts, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            print_usage(std::cout);
+            std::exit(0);
+        case 'k':
+            if (!parse_corpus_kind(optarg, opts.kind))
+            {
+                std::cerr << "Error: unknown corpus " << optarg << ".\n";
+                return false;
+            }
+            break;
+        case 's':
+            if (!parse_size(optarg, opts.size))
+            {
+                std::cerr << "Error: invalid corpus size " << optarg << ".\n";
+                return false;
+            }
+            break;
+        case 'S':
+            opts.seed = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'V':
+            opts.verify = true;
+            break;
+        case '?':
+            print_usage(std::cerr);
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    if (optind < argc)
+    {
+        std::cerr << "Error: unexpected argument " << argv[optind] << ".\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool write_all(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t count { write(STDOUT_FILENO, data, size) };
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+// reads up to size bytes, fewer only at the end of the input.
+bool read_all(uint8_t* data, size_t size, size_t& read_size)
+{
+    read_size = 0;
+    while (read_size < size)
+    {
+        ssize_t count { read(STDIN_FILENO, data + read_size, size - read_size) };
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            return false;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        read_size += count;
+    }
+    return true;
+}
+
+bool generate_corpus(const CorpusOptions& opts)
+{
+    CorpusGenerator generator { opts.kind, opts.seed };
+    std::vector<uint8_t> chunk(CHUNK_SIZE);
+
+    for (uint64_t written = 0; written < opts.size; written += chunk.size())
+    {
+        chunk.resize(std::min<uint64_t>(CHUNK_SIZE, opts.size - written));
+        generator.generate(chunk.data(), chunk.size());
+        if (!write_all(chunk.data(), chunk.size()))
+        {
+            std::cerr << "Error: failed to write the corpus after " << written << " bytes.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool verify_corpus(const CorpusOptions& opts)
+{
+    CorpusGenerator generator { opts.kind, opts.seed };
+    std::vector<uint8_t> expected(CHUNK_SIZE);
+    std::vector<uint8_t> actual(CHUNK_SIZE);
+
+    // one byte past the corpus is asked for at the end, to catch trailing data.
+    uint64_t checked { 0 };
+    while (true)
+    {
+        size_t size { static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, opts.size - checked)) };
+        size_t read_size {};
+        if (!read_all(actual.data(), std::max<size_t>(size, 1), read_size))
+        {
+            std::cerr << "Error: failed to read standard input after " << checked << " bytes.\n";
+            return false;
+        }
+        if (size == 0)
+        {
+            if (read_size > 0)
+            {
+                std::cerr << "Error: input is longer than the " << opts.size << " byte corpus.\n";
+                return false;
+            }
+            break;
+        }
+
+        generator.generate(expected.data(), size);
+        auto mismatch { std::mismatch(expected.begin(), expected.begin() + read_size, actual.begin()) };
+        if (mismatch.first != expected.begin() + read_size)
+        {
+            std::cerr << "Error: input differs from the corpus at byte " << checked + (mismatch.first - expected.begin()) << ".\n";
+            return false;
+        }
+        checked += read_size;
+        if (read_size < size)
+        {
+            std::cerr << "Error: input ends after " << checked << " of " << opts.size << " bytes.\n";
+            return false;
+        }
+    }
+
+    std::cerr << corpus_name(opts.kind) << ": " << checked << " bytes verified\n";
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    CorpusOptions opts {};
+    if (!process_arguments(opts, argc, argv))
+    {
+        return 1;
+    }
+
+    bool ok = opts.verify ? verify_corpus(opts) : generate_corpus(opts);
+
+    return ok ? 0 : 1;
+}
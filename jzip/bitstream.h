@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// loads 8 bytes as a big endian integer, so that the first byte in memory ends
+// up in the most significant bits. Bits are packed most significant bit first.
+inline uint64_t load_big_endian_64(const uint8_t* data)
+{
+    uint64_t word {};
+    std::memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// Reads a bitstream through a 64 bit buffer. The valid bits are kept left aligned
+// in m_buffer, so peeking n bits is a single shift. After refill() there are at
+// least 56 bits available unless the input is exhausted, which is enough to
+// resolve any code up to 32 bits without refilling mid-symbol.
+class BitReader
+{
+private:
+    const uint8_t* m_data {};
+    size_t m_size {};
+    size_t m_pos {};
+    uint64_t m_buffer {};
+    int m_count {};
+
+public:
+    BitReader(const uint8_t* data, size_t size)
+        : m_data { data }
+        , m_size { size }
+    {
+    }
+
+
+    void refill()
+    {
+        if (m_pos + 8 <= m_size)
+        {
+            // load a whole word and only advance by the bytes that fit. The extra
+            // bits or'd below m_count are the same bits the next refill will load.
+            m_buffer |= load_big_endian_64(m_data + m_pos) >> m_count;
+            int bytes { (63 - m_count) >> 3 };
+            m_pos += bytes;
+            m_count += bytes * 8;
+            return;
+        }
+
+        while (m_count <= 56 && m_pos < m_size)
+        {
+            m_buffer |= static_cast<uint64_t>(m_data[m_pos++]) << (56 - m_count);
+            m_count += 8;
+        }
+    }
+
+    // n must be between 1 and 32.
+    uint32_t peek(int n) const
+    {
+        return static_cast<uint32_t>(m_buffer >> (64 - n));
+    }
+
+    // same as peek, but n may also be 0.
+    uint32_t peek_any(int n) const
+    {
+        return static_cast<uint32_t>((m_buffer >> 1) >> (63 - n));
+    }
+
+    void consume(int n)
+    {
+        m_buffer <<= n;
+        m_count -= n;
+    }
+
+    // bits consumed from the start of the input. Past the end of the input, the
+    // reader feeds zeros, so this may exceed the input size on corrupt streams.
+    uint64_t bits_consumed() const
+    {
+        return static_cast<uint64_t>(m_pos) * 8 - m_count;
+    }
+};
+
+// Writes a bitstream through a 64 bit buffer. Codes are shifted in at the bottom 
+// and whole 32 bit words are flushed to the output as soon as they are complete, 
+// so the output vector only ever grows by word sized appends.
+class BitWriter
+{
+private:
+    std::vector<uint8_t>& m_out;
+    uint64_t m_buffer {};
+    int m_count {};
+
+    void append_word(uint32_t word)
+    {
+        size_t size { m_out.size() };
+        m_out.resize(size + 4);
+        m_out[size] = word >> 24;
+        m_out[size + 1] = word >> 16;
+        m_out[size + 2] = word >> 8;
+        m_out[size + 3] = word;
+    }
+
+public:
+    explicit BitWriter(std::vector<uint8_t>& out)
+        : m_out { out }
+    {
+    }
+
+    // length must be between 0 and 32, bits above length must be 0.
+    void write(uint32_t bits, int length)
+    {
+        m_buffer = (m_buffer << length) | bits;
+        m_count += length;
+        if (m_count >= 32)
+        {
+            m_count -= 32;
+            append_word(static_cast<uint32_t>(m_buffer >> m_count));
+        }
+    }
+
+    // writes out the pending bits, padding the last byte with 0s.
+    void flush()
+    {
+        while (m_count > 0)
+        {
+            int take { std::min(m_count, 8) };
+            m_count -= take;
+            m_out.push_back(static_cast<uint8_t>((m_buffer >> m_count) << (8 - take)));
+        }
+        m_buffer = 0;
+    }
+};
@@ -1,212 +1,896 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <fstream>
-#include <unordered_map>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "bitstream.h"
+#include "context_model.h"
+#include "dictionary.h"
+#include "format.h"
+#include "histogram.h"
 #include "huffman.h"
+#include "lz77.h"
+#include "tans.h"
+#include "pipeline.h"
+#include "thread_pool.h"
 #include "compress.h"
 
-bool count_chars_in_file(std::ifstream& infile, std::unordered_map<char, int>& char_counts) 
+// a block of the input together with its encoded form. The input points into the
+// mapped file, or into input_buffer when it had to be read. Blocks are recycled 
+// once written, so their buffers are only allocated once.
+struct BlockJob
 {
-    // start from the beginning of the file
-    infile.clear();
-    infile.seekg(0, std::ios::beg);
-    
-    char ch {};
-    while (infile.get(ch))
+    const uint8_t* input {};
+    size_t input_size {};
+    std::vector<uint8_t> input_buffer {};
+    std::vector<uint8_t> output {};
+    std::array<std::vector<uint8_t>, STREAM_COUNT> streams {};
+    std::vector<uint8_t> header {};
+    LzStreams lz_streams {};
+    MatchFinder match_finder {};
+    TansEncodeTable tans_table {};
+    std::vector<uint16_t> tans_scratch {};
+    PairHistograms pair_histograms {};
+    ContextModel context_model {};
+    uint64_t body_bits {};
+    uint64_t optimal_body_bits {};
+    Stats stats {}; // of this block, when the options collect stats
+    // with fewer blocks than threads, the block's worker has up to count_helpers 
+    // tasks on count_pool count bytes along with it.
+    ThreadPool* count_pool {};
+    int count_helpers {};
+    std::future<bool> done {};
+};
+
+Stats* block_stats(BlockJob& job, const CompressOptions& options)
+{
+    return options.stats ? &job.stats : nullptr;
+}
+
+// chunks below this size are not worth a task of their own.
+constexpr size_t MIN_PARALLEL_CHUNK_SIZE { 1 << 20 };
+
+// counts the bytes of data in chunks on the calling worker and up to helpers 
+// tasks on pool, then merges the counts. Chunks are claimed from a counter, so a 
+// helper that only starts once every chunk is taken has nothing left to do, and 
+// the caller only ever waits for chunks that other workers are counting. That 
+// keeps a worker from waiting on tasks queued behind it.
+void count_bytes_parallel(const uint8_t* data, size_t size, ThreadPool* pool, int helpers, ByteHistogram& histogram)
+{
+    size_t chunk_count { pool ? std::min<size_t>(helpers + 1, size / MIN_PARALLEL_CHUNK_SIZE) : 1 };
+    if (chunk_count <= 1)
+    {
+        count_bytes(data, size, histogram);
+        return;
+    }
+
+    // shared with the helper tasks, which may outlive the call.
+    struct ChunkCounts
+    {
+        std::vector<ByteHistogram> partials {};
+        std::atomic<size_t> next_chunk {};
+        size_t counted {};
+        std::mutex mutex {};
+        std::condition_variable condition {};
+    };
+    auto counts { std::make_shared<ChunkCounts>() };
+    counts->partials.resize(chunk_count);
+    size_t chunk_size { size / chunk_count };
+    auto count_chunks { [counts, data, size, chunk_size, chunk_count]()
     {
-        ++char_counts[ch];
+        for (size_t chunk = counts->next_chunk++; chunk < chunk_count; chunk = counts->next_chunk++)
+        {
+            size_t start { chunk * chunk_size };
+            size_t end { chunk + 1 == chunk_count ? size : start + chunk_size };
+            count_bytes(data + start, end - start, counts->partials[chunk]);
+            {
+                std::lock_guard<std::mutex> lock { counts->mutex };
+                ++counts->counted;
+            }
+            counts->condition.notify_all();
+        }
+    } };
+
+    for (size_t i = 0; i + 1 < chunk_count; ++i)
+    {
+        pool->submit(count_chunks);
     }
-    if (infile.eof())
+    count_chunks();
     {
-        infile.clear();
-        infile.seekg(0, std::ios::beg);
+        std::unique_lock<std::mutex> lock { counts->mutex };
+        counts->condition.wait(lock, [&]() { return counts->counted == chunk_count; });
     }
-    else
+
+    for (const ByteHistogram& partial : counts->partials)
+    {
+        for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+        {
+            histogram[symbol] += partial[symbol];
+        }
+    }
+}
+
+// blocks whose bytes' entropy saves less than this share of their size are 
+// stored without trying to code them, see encode_entropy_block.
+constexpr double MIN_ENTROPY_GAIN { 0.02 };
+
+void report_code_length_limit_cost(uint64_t limited_bits, uint64_t optimal_bits, int max_code_length)
+{
+    double cost { optimal_bits ? 100.0 * (limited_bits - optimal_bits) / optimal_bits : 0.0 };
+
+    std::cerr << "Code lengths limited to " << max_code_length << " bits: " 
+              << limited_bits << " body bits vs " << optimal_bits << " optimal (+" << cost << "%)\n";
+}
+
+void write_normalized_counts(std::vector<uint8_t>& out, const NormalizedCounts& counts, int table_log)
+{
+    // the table size, then the count of every byte value in order. Counts below 128 
+    // take one byte, larger ones two with the top bit set. Runs of zero counts are 
+    // collapsed like zero code lengths.
+    out.push_back(table_log);
+    for (size_t symbol = 0; symbol < counts.size(); ++symbol)
     {
+        uint16_t count { counts[symbol] };
+        if (count >= 128)
+        {
+            out.push_back(0x80 | (count >> 8));
+            out.push_back(count & 0xff);
+            continue;
+        }
+        out.push_back(count);
+        if (count != 0)
+        {
+            continue;
+        }
+
+        uint8_t run { 0 };
+        while (symbol + 1 < counts.size() && counts[symbol + 1] == 0)
+        {
+            ++run;
+            ++symbol;
+        }
+        out.push_back(run);
+    }
+}
+
+// fills in the payload size of the block starting at block_start, once everything 
+// after its header has been appended.
+void set_payload_size(std::vector<uint8_t>& out, size_t block_start)
+{
+    uint32_t payload_size = out.size() - block_start - BLOCK_HEADER_SIZE; // copy initialize to allow narrowing conversion.
+    for (int i = 0; i < 4; ++i)
+    {
+        out[block_start + 5 + i] = static_cast<uint8_t>(payload_size >> (8 * i));
+    }
+}
+
+void append_block_header(std::vector<uint8_t>& out, BlockMethod method, size_t raw_size)
+{
+    out.push_back(static_cast<uint8_t>(method));
+    append_u32(out, raw_size);
+    append_u32(out, 0);
+}
+
+void encode_stored_block(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    size_t block_start { out.size() };
+    append_block_header(out, BlockMethod::stored, size);
+    out.insert(out.end(), data, data + size);
+    set_payload_size(out, block_start);
+}
+
+void encode_adaptive_block(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    // the coder starts afresh for every block, so blocks stay independent.
+    size_t block_start { out.size() };
+    append_block_header(out, BlockMethod::adaptive_huffman, size);
+
+    AdaptiveHuffmanCoder coder {};
+    BitWriter writer { out };
+    for (size_t i = 0; i < size; ++i)
+    {
+        coder.encode(data[i], writer);
+    }
+    writer.flush();
+
+    set_payload_size(out, block_start);
+}
+
+void write_body(const uint8_t* data, size_t size, const HuffmanCodeTable& codes, std::vector<uint8_t>& out)
+{
+    BitWriter writer { out };
+    for (size_t i = 0; i < size; ++i)
+    {
+        const HuffmanCode& code { codes[data[i]] };
+        writer.write(code.bits, code.length);
+    }
+    writer.flush();
+}
+
+void write_streams(const uint8_t* data, size_t size, const HuffmanCodeTable& codes, BlockJob& job, std::vector<uint8_t>& out)
+{
+    // byte i goes to stream i % STREAM_COUNT. The decoder runs one bit reader per 
+    // stream, and as the streams don't depend on each other the CPU can overlap 
+    // their lookups. Each stream is written in its own pass, which keeps a single 
+    // writer's state in registers.
+    for (int stream = 0; stream < STREAM_COUNT; ++stream)
+    {
+        job.streams[stream].clear();
+        BitWriter writer { job.streams[stream] };
+        for (size_t i = stream; i < size; i += STREAM_COUNT)
+        {
+            const HuffmanCode& code { codes[data[i]] };
+            writer.write(code.bits, code.length);
+        }
+        writer.flush();
+
+        if (stream + 1 < STREAM_COUNT)
+        {
+            append_u32(out, job.streams[stream].size());
+        }
+    }
+    for (const std::vector<uint8_t>& stream : job.streams)
+    {
+        out.insert(out.end(), stream.begin(), stream.end());
+    }
+}
+
+bool encode_tans_block(const uint8_t* data, size_t size, const NormalizedCounts& counts, int table_log, BlockJob& job, std::vector<uint8_t>& out)
+{
+    TansEncodeTable& table { job.tans_table };
+    if (!table.build(counts, table_log))
+    {
+        std::cerr << "Failed to build tANS tables for " << size << " bytes\n";
         return false;
     }
 
+    size_t block_start { out.size() };
+    append_block_header(out, BlockMethod::tans, size);
+    write_normalized_counts(out, counts, table_log);
+
+    BitWriter writer { out };
+    table.encode(data, size, writer, job.tans_scratch);
+    writer.flush();
+
+    set_payload_size(out, block_start);
+
     return true;
 }
 
-bool build_tree_from_file(std::ifstream& infile, HuffmanTree& tree)
+void write_context_body(const uint8_t* data, size_t size, const std::array<uint8_t, 256>& cluster_of, 
+                        const std::array<HuffmanCodeTable, MAX_CONTEXT_CLUSTERS>& codes, std::vector<uint8_t>& out)
 {
-    std::unordered_map<char, int> char_counts {};
-    bool ok {};
+    // each previous byte leads straight to the code table of its cluster.
+    std::array<const HuffmanCode*, 256> table_of {};
+    for (size_t context = 0; context < table_of.size(); ++context)
+    {
+        table_of[context] = codes[cluster_of[context]].data();
+    }
 
-    ok = count_chars_in_file(infile, char_counts);
-    if (!ok)
+    // every byte depends on the one before, so this is a single stream.
+    BitWriter writer { out };
+    uint8_t previous { 0 };
+    for (size_t i = 0; i < size; ++i)
     {
-        std::cerr << "Failed to process characters in provided file.\n";
-        return false;
+        const HuffmanCode& code { table_of[previous][data[i]] };
+        writer.write(code.bits, code.length);
+        previous = data[i];
     }
+    writer.flush();
+}
 
-    tree = build_tree(char_counts);
+bool encode_context_block(const uint8_t* data, size_t size, const ContextModel& model, std::vector<uint8_t>& out)
+{
+    std::array<HuffmanCodeTable, MAX_CONTEXT_CLUSTERS> codes {};
+    for (int cluster = 0; cluster < model.cluster_count; ++cluster)
+    {
+        if (!build_canonical_codes(model.lengths[cluster], codes[cluster]))
+        {
+            std::cerr << "Failed to build prefix codes for context cluster " << cluster << "\n";
+            return false;
+        }
+    }
+
+    size_t block_start { out.size() };
+    append_block_header(out, BlockMethod::huffman_order1, size);
+    write_context_model(out, model);
+    write_context_body(data, size, model.cluster_of, codes, out);
+    set_payload_size(out, block_start);
 
     return true;
 }
 
-bool build_prefix_code_table_from_file(std::ifstream& infile, std::unordered_map<char, std::string>& prefix_code_table)
+void encode_dictionary_block(const uint8_t* data, size_t size, const Dictionary& dictionary, bool order1, std::vector<uint8_t>& out)
+{
+    // the tables are the dictionary's, so the payload is nothing but the codes.
+    size_t block_start { out.size() };
+    append_block_header(out, order1 ? BlockMethod::dictionary_order1 : BlockMethod::dictionary_huffman, size);
+    if (order1)
+    {
+        write_context_body(data, size, dictionary.model().cluster_of, dictionary.cluster_codes(), out);
+    }
+    else
+    {
+        write_body(data, size, dictionary.codes(), out);
+    }
+    set_payload_size(out, block_start);
+}
+
+// appends a block coding the bytes of data on their own, with the coder picked by 
+// the options. Data whose entropy saves less than min_gain of its size is stored.
+bool encode_entropy_block(const uint8_t* data, size_t size, BlockJob& job, const CompressOptions& options, double min_gain, std::vector<uint8_t>& out)
 {
+    PhaseTimer timer { block_stats(job, options), options.adaptive ? Phase::encode : Phase::count };
+    if (options.adaptive)
+    {
+        // there is no counting pass to tell data that doesn't compress, so it is 
+        // coded first and stored if that came out no smaller.
+        size_t block_start { out.size() };
+        encode_adaptive_block(data, size, out);
+        if (out.size() - block_start >= BLOCK_HEADER_SIZE + size)
+        {
+            out.resize(block_start);
+            encode_stored_block(data, size, out);
+        }
+        return true;
+    }
+
+    ByteHistogram histogram {};
+    CodeLengths lengths {};
+    HuffmanCodeTable codes {};
     bool ok {};
-    HuffmanTree tree {};
 
-    ok = build_tree_from_file(infile, tree);
+    count_bytes_parallel(data, size, job.count_pool, job.count_helpers, histogram);
+    timer.next(Phase::tables);
+
+    // already compressed or random data codes to about its own size at best, so 
+    // it is stored as it is instead of spending a full encode on a few bytes.
+    if (get_entropy_bits(histogram) >= (1.0 - min_gain) * 8 * size)
+    {
+        timer.next(Phase::encode);
+        encode_stored_block(data, size, out);
+        return true;
+    }
+
+    // a limit too short for a code over every byte in the block leaves nothing 
+    // to code with, so the block is kept as it is.
+    if (count_symbols(histogram) > (int64_t { 1 } << options.max_code_length))
+    {
+        timer.next(Phase::encode);
+        encode_stored_block(data, size, out);
+        return true;
+    }
+
+    ok = build_limited_code_lengths(histogram, options.max_code_length, lengths) && build_canonical_codes(lengths, codes);
     if (!ok)
     {
-        std::cerr << "Failed to build tree\n";
+        std::cerr << "Failed to build prefix codes of at most " << options.max_code_length << " bits for "
+                  << count_symbols(histogram) << " distinct bytes\n";
         return false;
     }
 
-    prefix_code_table = build_prefix_code_table(tree);
+    // the alternatives are weighed by payload size in bits, tables included.
+    std::vector<uint8_t>& header { job.header };
+    header.clear();
+    write_code_lengths(header, lengths);
+    size_t stream_table_size { options.interleave ? STREAM_TABLE_SIZE : 0 };
+    uint64_t best_bits { get_encoded_bit_count(histogram, lengths) + 8 * (header.size() + stream_table_size) };
 
-    return true;
-}
+    // order-1 tables pay off when bytes depend on the byte before them, as in text.
+    bool use_context_model { false };
+    if (options.context_model && options.coder != EntropyCoder::tans && size > 0)
+    {
+        uint64_t body_bits {};
+        timer.next(Phase::count);
+        count_byte_pairs(data, size, job.pair_histograms);
+        timer.next(Phase::tables);
+        if (!build_context_model(job.pair_histograms, options.max_code_length, job.context_model, body_bits))
+        {
+            std::cerr << "Failed to build order-1 prefix codes of at most " << options.max_code_length << " bits\n";
+            return false;
+        }
+        header.clear();
+        write_context_model(header, job.context_model);
+        use_context_model = body_bits + 8 * header.size() < best_bits;
+        best_bits = std::min(best_bits, body_bits + 8 * header.size());
+    }
 
-bool write_code_to_file(std::ofstream& outfile, const std::string& code)
-{
-    uint8_t current_byte { 0 };
-    int bit_count { 0 };
+    // a dictionary's tables are not stored at all, which tends to win on small 
+    // blocks. The smaller of its order-0 and order-1 codes is taken.
+    uint64_t dictionary_bits { UINT64_MAX };
+    bool dictionary_order1 { false };
+    if (options.dictionary)
+    {
+        const Dictionary& dictionary { *options.dictionary };
+        uint64_t order1_bits { dictionary.get_order1_bit_count(data, size) };
+        dictionary_bits = get_encoded_bit_count(histogram, dictionary.lengths());
+        dictionary_order1 = order1_bits < dictionary_bits;
+        dictionary_bits = std::min(dictionary_bits, order1_bits);
+    }
 
-    for (char bit : code)
+    // tANS gets close to the entropy where Huffman rounds every code to whole bits. 
+    // With the automatic coder, the block takes whichever is smallest.
+    if (options.coder != EntropyCoder::huffman && size > 0)
     {
-        if (bit == '1')
+        int table_log { choose_table_log(histogram, size) };
+        NormalizedCounts counts {};
+        if (!normalize_counts(histogram, table_log, counts))
         {
-            current_byte |= (1 << (7 - bit_count)); // adds 1 to the desired position.
+            std::cerr << "Failed to normalize counts of " << count_symbols(histogram) << " distinct bytes\n";
+            return false;
         }
-        ++bit_count;
 
-        // flush byte
-        if (bit_count == 8)
+        header.clear();
+        write_normalized_counts(header, counts, table_log);
+        uint64_t tans_bits { get_tans_bit_count(histogram, counts, table_log) + 8 * header.size() };
+        // even when forced, tANS has to beat the blocks that carry no tables.
+        bool beats_tableless { tans_bits < dictionary_bits && tans_bits < 8 * size };
+        if ((options.coder == EntropyCoder::tans || tans_bits < best_bits) && beats_tableless)
         {
-            outfile.put(current_byte);
-            current_byte = 0;
-            bit_count = 0;
+            timer.next(Phase::encode);
+            return encode_tans_block(data, size, counts, table_log, job, out);
         }
     }
 
-    // left over bits are packed into a byte. 
-    if (bit_count > 0)
+    // best_bits counts the tables, and dictionary blocks carry none, so this 
+    // compares whole payloads: a block no coding makes smaller is stored.
+    timer.next(Phase::encode);
+    if (std::min(best_bits, dictionary_bits) >= 8 * size)
     {
-        outfile.put(current_byte);
+        encode_stored_block(data, size, out);
+        return true;
     }
 
-    if (outfile.bad())
+    if (dictionary_bits <= best_bits)
     {
-        return false;
+        encode_dictionary_block(data, size, *options.dictionary, dictionary_order1, out);
+        return true;
     }
 
+    if (use_context_model)
+    {
+        return encode_context_block(data, size, job.context_model, out);
+    }
+
+    if (options.verbose)
+    {
+        job.body_bits += get_encoded_bit_count(histogram, lengths);
+        job.optimal_body_bits += get_encoded_bit_count(histogram, build_code_lengths(build_tree(histogram)));
+    }
+
+    // block header, the payload size is filled in once the body is encoded.
+    size_t block_start { out.size() };
+    append_block_header(out, options.interleave ? BlockMethod::huffman_streams : BlockMethod::huffman, size);
+
+    write_code_lengths(out, lengths);
+
+    // the last byte of each stream is padded with 0s. The decoder knows the number
+    // of symbols from the block header, so it never reads into the padding.
+    if (options.interleave)
+    {
+        write_streams(data, size, codes, job, out);
+    }
+    else
+    {
+        write_body(data, size, codes, out);
+    }
+
+    set_payload_size(out, block_start);
+
     return true;
 }
 
-bool write_compressed_header_to_file(std::ofstream& outfile, const std::unordered_map<char, std::string>& prefix_table)
+bool encode_lz77_block(BlockJob& job, const CompressOptions& options)
 {
-    // we write the number of elements in the prefix table to the header first to determine 
-    // how much of the file is part of the header.
-    uint16_t header_size = prefix_table.size(); // copy initialize to allow narrowing conversion.
-    outfile.write(reinterpret_cast<const char*>(&header_size), sizeof(header_size));
-    bool ok {};
+    // the block holds the window size and the four sequence streams, each coded 
+    // as a nested block of its own so every stream gets codes fitted to it. Streams 
+    // like the offsets are close to random but still gain a little from coding, 
+    // so they are only stored when coding doesn't gain at all.
+    LzStreams& streams { job.lz_streams };
+    {
+        PhaseTimer timer { block_stats(job, options), Phase::match };
+        job.match_finder.parse(job.input, job.input_size, options.level, options.window_bits, streams);
+    }
 
-    for (const auto& [ch, prefix_code] : prefix_table)
+    std::vector<uint8_t>& out { job.output };
+    append_block_header(out, BlockMethod::lz77, job.input_size);
+    out.push_back(options.window_bits);
+    for (const std::vector<uint8_t>* stream : { &streams.literals, &streams.tokens, &streams.offsets, &streams.lengths })
     {
-        // we place the character, the size of the prefix_code, and the prefix_code in that 
-        // order, so we know how many bits to read to retrieve the code.
-        uint8_t prefix_code_size = prefix_code.size(); // copy initialize to allow narrowing conversion.
-        outfile.put(ch);
-        outfile.put(prefix_code_size);
-        ok = write_code_to_file(outfile, prefix_code);
-        if (!ok)
+        if (!encode_entropy_block(stream->data(), stream->size(), job, options, 0.0, out))
         {
             return false;
         }
     }
+    set_payload_size(out, 0);
 
-    if (outfile.bad())
+    // matches that don't pay for their streams' tables leave the block as it was.
+    if (out.size() > BLOCK_HEADER_SIZE + job.input_size)
+    {
+        out.clear();
+        encode_stored_block(job.input, job.input_size, out);
+    }
+
+    return true;
+}
+
+// the counters of a block just encoded, for the stats.
+void count_block(BlockJob& job)
+{
+    Stats& stats { job.stats };
+    stats.add_block(job.output[0], job.input_size, job.output.size());
+    stats.input_bytes += job.input_size;
+    stats.output_bytes += job.output.size();
+
+    uint64_t buffer_bytes { job.input_buffer.capacity() + job.output.capacity() + job.header.capacity() + job.tans_scratch.capacity() * sizeof(uint16_t) };
+    for (const std::vector<uint8_t>& stream : job.streams)
+    {
+        buffer_bytes += stream.capacity();
+    }
+    for (const std::vector<uint8_t>* stream : { &job.lz_streams.literals, &job.lz_streams.tokens, &job.lz_streams.offsets, &job.lz_streams.lengths })
+    {
+        buffer_bytes += stream->capacity();
+    }
+    stats.block_buffer_bytes = buffer_bytes;
+}
+
+bool encode_block(BlockJob& job, const CompressOptions& options)
+{
+    job.output.clear();
+    job.body_bits = 0;
+    job.optimal_body_bits = 0;
+    job.stats = {};
+
+    bool ok = options.level > 0 ? encode_lz77_block(job, options)
+                                : encode_entropy_block(job.input, job.input_size, job, options, MIN_ENTROPY_GAIN, job.output);
+    if (ok && options.stats)
+    {
+        count_block(job);
+    }
+
+    return ok;
+}
+
+bool StreamSink::write(const uint8_t* data, size_t size)
+{
+    m_stream.write(reinterpret_cast<const char*>(data), size);
+    m_size += size;
+    return !m_stream.bad();
+}
+
+bool BufferSink::write(const uint8_t* data, size_t size)
+{
+    if (size > m_capacity - m_size)
     {
         return false;
     }
+    std::copy(data, data + size, m_out + m_size);
+    m_size += size;
+    return true;
+}
 
+size_t compress_bound(size_t size, size_t block_size)
+{
+    size_t block_count { block_size > 0 ? (size + block_size - 1) / block_size : 0 };
+    return FILE_HEADER_SIZE + DICTIONARY_ID_SIZE + block_count * (BLOCK_HEADER_SIZE + INDEX_ENTRY_SIZE + max_payload_size(std::min(size, block_size)))
+         + 1 + FOOTER_SIZE;
+}
+
+bool check_block_size(const CompressOptions& options)
+{
+    if (options.block_size == 0 || options.block_size > MAX_BLOCK_SIZE)
+    {
+        std::cerr << "Block size must be between 1 and " << MAX_BLOCK_SIZE << " bytes\n";
+        return false;
+    }
     return true;
 }
 
-bool write_compressed_body_to_file(std::ifstream& infile, std::ofstream& outfile, const std::unordered_map<char, std::string>& prefix_table)
+uint8_t file_flags(const CompressOptions& options)
 {
-    // go to the top of the source infile to read the whole file.
-    infile.clear();
-    infile.seekg(0, std::ios::beg);
+    return options.dictionary ? FLAG_DICTIONARY : 0;
+}
 
-    char ch {};
-    std::string prefix_code {};
-    std::string prefix_codes { "" };
-    bool ok {};
+bool write_file_header(OutputSink& sink, const CompressOptions& options)
+{
+    uint8_t flags { file_flags(options) };
+    uint32_t id { options.dictionary ? options.dictionary->id() : 0 };
+    const uint8_t header[FILE_HEADER_SIZE + DICTIONARY_ID_SIZE] { 
+        FILE_MAGIC[0], FILE_MAGIC[1], FILE_MAGIC[2], FILE_MAGIC[3], FORMAT_VERSION, flags,
+        static_cast<uint8_t>(id), static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id >> 16), static_cast<uint8_t>(id >> 24)
+    };
+    return sink.write(header, file_header_size(flags));
+}
+
+void append_index_entry(std::vector<uint8_t>& index, uint64_t offset, const BlockJob& job)
+{
+    append_u64(index, offset);
+    append_u32(index, job.output.size());
+    append_u32(index, job.input_size);
+}
+
+// the end marker, then the block index so decoders can seek to any block. offset 
+// is where the end marker goes. Appends the footer to index. A single block is 
+// found without an index, so it gets none.
+bool write_file_trailer(OutputSink& sink, std::vector<uint8_t>& index, uint64_t offset)
+{
+    const uint8_t end { static_cast<uint8_t>(BlockMethod::end) };
+    uint64_t block_count { index.size() / INDEX_ENTRY_SIZE };
+    if (block_count <= 1)
+    {
+        return sink.write(&end, 1);
+    }
+    append_u64(index, block_count);
+    append_u64(index, offset + 1);
+    index.insert(index.end(), std::begin(INDEX_MAGIC), std::end(INDEX_MAGIC));
+
+    return sink.write(&end, 1) && sink.write(index.data(), index.size());
+}
+
+bool compress_file(InputSource& input, std::ostream& outfile, const CompressOptions& options)
+{
+    ThreadPool pool { options.threads > 0 ? options.threads : default_thread_count() };
+    return compress_file(input, outfile, options, pool);
+}
+
+bool compress_file(InputSource& input, std::ostream& outfile, const CompressOptions& options, ThreadPool& pool)
+{
+    if (!check_block_size(options))
+    {
+        return false;
+    }
 
-    while (infile.get(ch))
+    StreamSink sink { outfile };
+    if (!write_file_header(sink, options))
     {
-        // retrieve prefix code from table. If the char is not in the table, we've fucked up. 
-        auto it { prefix_table.find(ch) };
-        if (it != prefix_table.end())
+        std::cerr << "Failed to write to file\n";
+        return false;
+    }
+    uint64_t offset { file_header_size(file_flags(options)) };
+    std::vector<uint8_t> index {};
+
+    // when there are fewer blocks than threads, the spare workers help count the 
+    // bytes of each block instead.
+    int count_helpers { 0 };
+    if (input.is_mapped())
+    {
+        uint64_t block_count { (input.size() + options.block_size - 1) / options.block_size };
+        count_helpers = std::max<uint64_t>(1, pool.size() / std::max<uint64_t>(block_count, 1)) - 1;
+    }
+
+    // blocks are read on this thread, encoded in parallel and written in order by 
+    // the pipeline's writer. A few more blocks than threads are kept in flight so 
+    // workers never wait on the reader or the writer.
+    uint64_t body_bits { 0 };
+    uint64_t optimal_body_bits { 0 };
+    // the reader and the writer keep stats of their own, added up at the end.
+    const size_t depth { 2 * static_cast<size_t>(pool.size()) };
+    Stats read_stats {};
+    Stats write_stats {};
+    BlockPipeline<BlockJob> pipeline { depth, [&](BlockJob& job)
+    {
+        PhaseTimer timer { options.stats ? &write_stats : nullptr, Phase::write };
+        append_index_entry(index, offset, job);
+        offset += job.output.size();
+        body_bits += job.body_bits;
+        optimal_body_bits += job.optimal_body_bits;
+        write_stats.add(job.stats);
+        if (!sink.write(job.output.data(), job.output.size()))
         {
-            prefix_code = it->second;
+            std::cerr << "Failed to write to file\n";
+            return false;
         }
-        else 
+        return true;
+    } };
+
+    bool ok { true };
+    while (BlockJob* job = pipeline.next())
+    {
+        PhaseTimer timer { options.stats ? &read_stats : nullptr, Phase::read };
+        if (!input.read_span(options.block_size, job->input_buffer, job->input, job->input_size))
         {
-            std::cerr << "Source file has been corrupted\n";
-            return false;
+            std::cerr << "Failed to read from file\n";
+            ok = false;
+            break;
+        }
+        if (job->input_size == 0)
+        {
+            break;
         }
+        job->count_pool = &pool;
+        job->count_helpers = count_helpers;
+        job->done = pool.submit([job, &options]() { return encode_block(*job, options); });
+        pipeline.submit();
+    }
+
+    if (!pipeline.finish() || !ok)
+    {
+        return false;
+    }
+
+    if (!write_file_trailer(sink, index, offset) || outfile.bad())
+    {
+        std::cerr << "Failed to write to file\n";
+        return false;
+    }
+
+    if (options.stats)
+    {
+        write_stats.add(read_stats);
+        write_stats.output_bytes = sink.size();
+        write_stats.jobs_in_flight = depth;
+        options.stats->add(write_stats);
+    }
 
-        // add code to bit_string and write it all to the file as bits in the end.
-        prefix_codes += prefix_code;
+    if (options.verbose && !options.adaptive)
+    {
+        report_code_length_limit_cost(body_bits, optimal_body_bits, options.max_code_length);
     }
 
-    // last byte that we write will pack trailing 0s for bits. We don't want to 
-    // accidentally read these when decompressing. 
-    // double modulo to deal with the case that the size of bit_string is a multiple of 8. 
-    // copy intialize to allow narrowing conversion.
-    uint8_t trailing_bits = (8 - (prefix_codes.size() % 8)) % 8;
+    return true;
+}
 
-    // we write the number of trailing_bits first so that we know to ignore these 
-    // bits when decompressing. 
-    outfile.write(reinterpret_cast<const char*>(&trailing_bits), sizeof(trailing_bits));
 
-    ok = write_code_to_file(outfile, prefix_codes);
-    if (!ok)
+struct CompressContext::State
+{
+    CompressOptions options {};
+    BlockJob job {};
+    std::vector<uint8_t> pending {}; // input of the block being filled
+    std::vector<uint8_t> index {};
+    uint64_t offset {};
+    bool started {};
+};
+
+CompressContext::CompressContext(const CompressOptions& options)
+    : m_state { std::make_unique<State>() }
+{
+    m_state->options = options;
+}
+
+CompressContext::~CompressContext() = default;
+
+bool CompressContext::start(OutputSink& sink)
+{
+    State& state { *m_state };
+    if (state.started)
+    {
+        return true;
+    }
+    if (!check_block_size(state.options))
     {
-        std::cerr << "Failed to write to file\n";
         return false;
     }
 
-    if (infile.bad() || outfile.bad())
+    state.started = true;
+    state.offset = file_header_size(file_flags(state.options));
+    state.index.clear();
+    state.pending.clear();
+    if (!write_file_header(sink, state.options))
     {
-        std::cerr << "Failed to write to file\n";
+        std::cerr << "Failed to write compressed data\n";
         return false;
     }
 
     return true;
 }
 
-bool compress_file(std::ifstream& infile, std::ofstream& outfile)
+bool CompressContext::encode(const uint8_t* data, size_t size, OutputSink& sink)
 {
-    std::unordered_map<char, std::string> prefix_code_table {};
-    bool ok {};
+    State& state { *m_state };
+    BlockJob& job { state.job };
+    job.input = data;
+    job.input_size = size;
+    if (!encode_block(job, state.options))
+    {
+        return false;
+    }
 
-    ok = build_prefix_code_table_from_file(infile, prefix_code_table);
-    if (!ok)
+    append_index_entry(state.index, state.offset, job);
+    state.offset += job.output.size();
+    if (state.options.stats)
+    {
+        job.stats.jobs_in_flight = 1;
+        state.options.stats->add(job.stats);
+    }
+    if (!sink.write(job.output.data(), job.output.size()))
     {
+        std::cerr << "Failed to write compressed data\n";
         return false;
     }
 
-    ok = write_compressed_header_to_file(outfile, prefix_code_table);
-    if (!ok)
+    return true;
+}
+
+bool CompressContext::push(const uint8_t* data, size_t size, OutputSink& sink)
+{
+    State& state { *m_state };
+    if (!start(sink))
     {
         return false;
     }
 
-    ok = write_compressed_body_to_file(infile, outfile, prefix_code_table);
-    if (!ok)
+    // whole blocks are encoded straight from data, only the ends are copied so 
+    // they can be completed by the next push.
+    const size_t block_size { state.options.block_size };
+    while (size > 0)
+    {
+        if (state.pending.empty() && size >= block_size)
+        {
+            if (!encode(data, block_size, sink))
+            {
+                return false;
+            }
+            data += block_size;
+            size -= block_size;
+            continue;
+        }
+
+        size_t count { std::min(size, block_size - state.pending.size()) };
+        state.pending.insert(state.pending.end(), data, data + count);
+        data += count;
+        size -= count;
+        if (state.pending.size() == block_size && !flush(sink))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CompressContext::flush(OutputSink& sink)
+{
+    State& state { *m_state };
+    if (!start(sink))
     {
         return false;
     }
+    if (state.pending.empty())
+    {
+        return true;
+    }
+
+    bool ok { encode(state.pending.data(), state.pending.size(), sink) };
+    state.pending.clear();
+
+    return ok;
+}
+
+bool CompressContext::finish(OutputSink& sink)
+{
+    State& state { *m_state };
+    if (!flush(sink))
+    {
+        state.started = false;
+        return false;
+    }
+
+    state.started = false;
+    if (!write_file_trailer(sink, state.index, state.offset))
+    {
+        std::cerr << "Failed to write compressed data\n";
+        return false;
+    }
 
     return true;
-}
\ No newline at end of file
+}
+
+bool CompressContext::compress(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_capacity, size_t& out_size)
+{
+    // anything left of an unfinished stream is dropped.
+    m_state->started = false;
+
+    BufferSink sink { out, out_capacity };
+    bool ok = push(in, in_size, sink) && finish(sink);
+    out_size = sink.size();
+    m_state->started = false;
+
+    return ok;
+}
@@ -1,6 +1,117 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <memory>
 
-bool compress_file(std::ifstream& infile, std::ofstream& outfile);
\ No newline at end of file
+#include "dictionary.h"
+#include "format.h"
+#include "huffman.h"
+#include "input_source.h"
+#include "lz77.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+enum class EntropyCoder
+{
+    huffman,
+    tans,
+    automatic, // the smaller of the two for each block
+};
+
+struct CompressOptions
+{
+    int level {}; // LZ77 match search effort from 1 to 9, 0 for Huffman coding alone
+    int window_bits { DEFAULT_WINDOW_BITS };
+    int max_code_length { DEFAULT_MAX_CODE_LENGTH };
+    size_t block_size { DEFAULT_BLOCK_SIZE };
+    int threads {}; // 0 uses one thread per core
+    EntropyCoder coder { EntropyCoder::huffman };
+    bool context_model {}; // also try order-1 Huffman tables, see context_model.h
+    bool interleave { true }; // deal static Huffman codes to STREAM_COUNT streams
+    bool adaptive {}; // adaptive Huffman, no counting pass or code lengths per block
+    const Dictionary* dictionary {}; // also try the dictionary's tables, see dictionary.h
+    bool verbose {};
+    Stats* stats {}; // counters and phase times are added to it, see stats.h
+};
+
+bool compress_file(InputSource& input, std::ostream& outfile, const CompressOptions& options = {});
+
+// encodes the blocks on pool instead of a pool of options.threads of its own. The 
+// pool may be shared with other files, but the calling thread must not be one of 
+// its workers, as it waits on the blocks.
+bool compress_file(InputSource& input, std::ostream& outfile, const CompressOptions& options, ThreadPool& pool);
+// receives compressed data as it is produced.
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+    virtual bool write(const uint8_t* data, size_t size) = 0;
+};
+
+class StreamSink : public OutputSink
+{
+private:
+    std::ostream& m_stream;
+    uint64_t m_size {};
+
+public:
+    explicit StreamSink(std::ostream& stream) : m_stream { stream } {}
+    bool write(const uint8_t* data, size_t size) override;
+    uint64_t size() const { return m_size; }
+};
+
+// fills a caller's buffer and fails a write that doesn't fit.
+class BufferSink : public OutputSink
+{
+private:
+    uint8_t* m_out {};
+    size_t m_capacity {};
+    size_t m_size {};
+
+public:
+    BufferSink(uint8_t* out, size_t capacity) : m_out { out }, m_capacity { capacity } {}
+    bool write(const uint8_t* data, size_t size) override;
+    size_t size() const { return m_size; }
+};
+
+// the largest jzip file size bytes can compress to with the given block size.
+size_t compress_bound(size_t size, size_t block_size = DEFAULT_BLOCK_SIZE);
+
+// Compression without files. A context keeps its buffers, code tables and match
+// finder from one call to the next, so once they have grown to fit a block it
+// compresses without allocating. Blocks are encoded on the calling thread, and a
+// context must only be used by one thread at a time.
+class CompressContext
+{
+private:
+    struct State;
+    std::unique_ptr<State> m_state;
+
+    bool start(OutputSink& sink);
+    bool encode(const uint8_t* data, size_t size, OutputSink& sink);
+
+public:
+    explicit CompressContext(const CompressOptions& options = {});
+    ~CompressContext();
+
+    CompressContext(const CompressContext&) = delete;
+    CompressContext& operator= (const CompressContext&) = delete;
+
+    // adds data to the current file, writing each block to sink as it fills up. 
+    // The first call after finish starts a new file.
+    bool push(const uint8_t* data, size_t size, OutputSink& sink);
+
+    // ends the current block early, so everything pushed so far can be decoded 
+    // from what has been written.
+    bool flush(OutputSink& sink);
+
+    // flushes and writes the end of the file with its block index.
+    bool finish(OutputSink& sink);
+
+    // compresses in to a complete jzip file in out and sets out_size to its size. 
+    // Fails when it doesn't fit, which an out_capacity of compress_bound rules out.
+    bool compress(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_capacity, size_t& out_size);
+};
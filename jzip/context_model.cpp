@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "context_model.h"
+
+constexpr int CLUSTER_ITERATIONS { 6 };
+
+void count_byte_pairs(const uint8_t* data, size_t size, PairHistograms& histograms)
+{
+    histograms.assign(256, ByteHistogram {});
+    uint8_t previous { 0 };
+    for (size_t i = 0; i < size; ++i)
+    {
+        ++histograms[previous][data[i]];
+        previous = data[i];
+    }
+}
+
+// estimated bits per byte value for data coded with a cluster's statistics. Bytes
+// the cluster hasn't seen get a small share, so contexts can still move there.
+void estimate_costs(const ByteHistogram& histogram, std::array<double, 256>& costs)
+{
+    uint64_t total { std::accumulate(histogram.begin(), histogram.end(), uint64_t { 0 }) };
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        costs[symbol] = -std::log2((histogram[symbol] + 0.5) / (total + 128.0));
+    }
+}
+
+bool build_context_model(const PairHistograms& histograms, int max_length, ContextModel& model, uint64_t& body_bits)
+{
+    // everything is in fixed size arrays, so models built over and over don't allocate.
+    std::array<uint64_t, 256> totals {};
+    std::array<int, 256> context_list {};
+    size_t context_count { 0 };
+    for (int context = 0; context < 256; ++context)
+    {
+        totals[context] = std::accumulate(histograms[context].begin(), histograms[context].end(), uint64_t { 0 });
+        if (totals[context] > 0)
+        {
+            context_list[context_count++] = context;
+        }
+    }
+    const auto contexts_begin { context_list.begin() };
+    const auto contexts_end { context_list.begin() + context_count };
+
+    // the busiest contexts seed the clusters. Then, like k-means, every context
+    // moves to the cluster that codes it in the fewest bits and the clusters are
+    // recounted from their members, until nothing moves.
+    std::sort(contexts_begin, contexts_end, [&](int a, int b) { return totals[a] > totals[b]; });
+    int cluster_count { std::min<int>(MAX_CONTEXT_CLUSTERS, std::max<size_t>(context_count, 1)) };
+    model.cluster_of.fill(0);
+    for (int cluster = 0; cluster < cluster_count && cluster < static_cast<int>(context_count); ++cluster)
+    {
+        model.cluster_of[context_list[cluster]] = cluster;
+    }
+
+    std::array<ByteHistogram, MAX_CONTEXT_CLUSTERS> cluster_histograms {};
+    std::array<std::array<double, 256>, MAX_CONTEXT_CLUSTERS> costs {};
+    for (int cluster = 0; cluster < cluster_count; ++cluster)
+    {
+        cluster_histograms[cluster] = histograms[context_count == 0 ? 0 : context_list[cluster]];
+    }
+
+    for (int iteration = 0; iteration < CLUSTER_ITERATIONS; ++iteration)
+    {
+        for (int cluster = 0; cluster < cluster_count; ++cluster)
+        {
+            estimate_costs(cluster_histograms[cluster], costs[cluster]);
+        }
+
+        bool moved { false };
+        for (auto context { contexts_begin }; context != contexts_end; ++context)
+        {
+            int best { 0 };
+            double best_cost { INFINITY };
+            for (int cluster = 0; cluster < cluster_count; ++cluster)
+            {
+                double cost { 0.0 };
+                for (size_t symbol = 0; symbol < 256; ++symbol)
+                {
+                    cost += histograms[*context][symbol] * costs[cluster][symbol];
+                }
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best = cluster;
+                }
+            }
+            moved = moved || model.cluster_of[*context] != best;
+            model.cluster_of[*context] = best;
+        }
+
+        for (ByteHistogram& histogram : cluster_histograms)
+        {
+            histogram.fill(0);
+        }
+        for (auto context { contexts_begin }; context != contexts_end; ++context)
+        {
+            ByteHistogram& histogram { cluster_histograms[model.cluster_of[*context]] };
+            for (size_t symbol = 0; symbol < 256; ++symbol)
+            {
+                histogram[symbol] += histograms[*context][symbol];
+            }
+        }
+
+        if (!moved && iteration > 0)
+        {
+            break;
+        }
+    }
+
+    // clusters left without contexts are dropped and the rest numbered in order.
+    std::array<int, MAX_CONTEXT_CLUSTERS> renumbered {};
+    model.cluster_count = 0;
+    for (int cluster = 0; cluster < cluster_count; ++cluster)
+    {
+        bool used { std::any_of(contexts_begin, contexts_end, [&](int context) { return model.cluster_of[context] == cluster; }) };
+        renumbered[cluster] = used ? model.cluster_count : -1;
+        if (used)
+        {
+            if (!build_limited_code_lengths(cluster_histograms[cluster], max_length, model.lengths[model.cluster_count]))
+            {
+                return false;
+            }
+            ++model.cluster_count;
+        }
+    }
+    if (model.cluster_count == 0)
+    {
+        model.cluster_count = 1;
+        model.lengths[0].fill(0);
+        return true;
+    }
+
+    body_bits = 0;
+    for (int context = 0; context < 256; ++context)
+    {
+        int cluster { totals[context] > 0 ? renumbered[model.cluster_of[context]] : 0 };
+        model.cluster_of[context] = cluster;
+        body_bits += get_encoded_bit_count(histograms[context], model.lengths[cluster]);
+    }
+
+    return true;
+}
+
+void write_context_model(std::vector<uint8_t>& out, const ContextModel& model)
+{
+    // the cluster count, the cluster of every previous byte as (cluster, run - 1) 
+    // pairs, then the code lengths of each cluster.
+    out.push_back(model.cluster_count);
+    for (size_t context = 0; context < model.cluster_of.size();)
+    {
+        size_t run { 1 };
+        while (context + run < model.cluster_of.size() && model.cluster_of[context + run] == model.cluster_of[context])
+        {
+            ++run;
+        }
+        out.push_back(model.cluster_of[context]);
+        out.push_back(run - 1);
+        context += run;
+    }
+    for (int cluster = 0; cluster < model.cluster_count; ++cluster)
+    {
+        write_code_lengths(out, model.lengths[cluster]);
+    }
+}
+
+bool read_context_model(const uint8_t* data, size_t size, ContextModel& model, size_t& header_size)
+{
+    size_t pos { 1 };
+    model.cluster_count = size > 0 ? data[0] : 0;
+    bool ok { model.cluster_count >= 1 && model.cluster_count <= MAX_CONTEXT_CLUSTERS };
+    for (size_t context = 0; ok && context < model.cluster_of.size();)
+    {
+        ok = size - pos >= 2 && data[pos] < model.cluster_count && context + data[pos + 1] < model.cluster_of.size();
+        if (ok)
+        {
+            std::fill_n(model.cluster_of.begin() + context, data[pos + 1] + 1, data[pos]);
+            context += data[pos + 1] + 1;
+            pos += 2;
+        }
+    }
+
+    for (int cluster = 0; ok && cluster < model.cluster_count; ++cluster)
+    {
+        size_t lengths_size {};
+        ok = read_code_lengths(data + pos, size - pos, model.lengths[cluster], lengths_size);
+        pos += lengths_size;
+    }
+    header_size = pos;
+
+    return ok;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "format.h"
+#include "histogram.h"
+#include "huffman.h"
+
+// Order-1 context modelling. Each byte is coded with a Huffman table picked by
+// the byte before it (0 before the first byte of a block). One table per previous
+// byte would cost too much to store, so the 256 contexts are grouped into at most
+// MAX_CONTEXT_CLUSTERS clusters of contexts with similar statistics, and each
+// cluster gets one canonical code.
+
+constexpr int MAX_CONTEXT_CLUSTERS { MAX_CLUSTER_TABLES };
+
+// byte histograms per previous byte.
+using PairHistograms = std::vector<ByteHistogram>;
+
+struct ContextModel
+{
+    std::array<uint8_t, 256> cluster_of {}; // cluster of each previous byte
+    int cluster_count {};
+    std::array<CodeLengths, MAX_CONTEXT_CLUSTERS> lengths {};
+};
+
+void count_byte_pairs(const uint8_t* data, size_t size, PairHistograms& histograms);
+
+// clusters the contexts and builds a code of at most max_length bits per cluster.
+// body_bits is set to the size of the data coded with the model.
+bool build_context_model(const PairHistograms& histograms, int max_length, ContextModel& model, uint64_t& body_bits);
+
+// serialized model, as stored in block and dictionary headers. header_size is set
+// to the number of bytes read.
+void write_context_model(std::vector<uint8_t>& out, const ContextModel& model);
+bool read_context_model(const uint8_t* data, size_t size, ContextModel& model, size_t& header_size);
@@ -1,194 +1,1108 @@
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <fstream>
-#include <unordered_map>
+#include <cerrno>
+#include <cstring>
 #include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include "utils.h"
+#include "bitstream.h"
+#include "context_model.h"
+#include "dictionary.h"
+#include "format.h"
+#include "huffman.h"
+#include "input_source.h"
+#include "lz77.h"
+#include "tans.h"
+#include "pipeline.h"
+#include "thread_pool.h"
 #include "decompress.h"
 
+inline bool decode_symbol(BitReader& reader, const HuffmanDecodeEntry* primary, const HuffmanDecodeEntry* secondary, uint8_t& symbol)
+{
+    reader.refill();
+
+    // most symbols resolve in the primary table. Long codes take one more 
+    // lookup in the secondary table linked from their prefix.
+    HuffmanDecodeEntry entry { primary[reader.peek(HuffmanDecodeTable::PRIMARY_BITS)] };
+    if (entry.length == 0)
+    {
+        if (entry.sub_bits == 0)
+        {
+            return false;
+        }
+        reader.consume(HuffmanDecodeTable::PRIMARY_BITS);
+        entry = secondary[entry.value + reader.peek(entry.sub_bits)];
+        if (entry.length == 0)
+        {
+            return false;
+        }
+    }
+    reader.consume(entry.length);
+    symbol = entry.value;
 
-bool read_code_by_bits_from_file(std::ifstream& infile, uint8_t bit_count, std::string& code_string)
+    return true;
+}
+
+bool read_normalized_counts(const uint8_t* data, size_t size, NormalizedCounts& counts, int& table_log, size_t& header_size)
 {
-    uint8_t current_byte {};
-    int remaining_bits { bit_count };
-    int remaining_bits_per_byte {};
+    // the table size, then the count of every byte value in order, see write_normalized_counts.
+    if (size < 1)
+    {
+        return false;
+    }
+    table_log = data[0];
+    size_t pos { 1 };
+    size_t symbol { 0 };
+    while (symbol < counts.size())
+    {
+        if (pos >= size)
+        {
+            return false;
+        }
+        uint8_t byte { data[pos++] };
+        if (byte & 0x80)
+        {
+            if (pos >= size)
+            {
+                return false;
+            }
+            counts[symbol++] = ((byte & 0x7f) << 8) | data[pos++];
+            continue;
+        }
+        counts[symbol++] = byte;
+        if (byte != 0)
+        {
+            continue;
+        }
 
-    while (remaining_bits > 0)
+        if (pos >= size || symbol + data[pos] > counts.size())
+        {
+            return false;
+        }
+        for (uint8_t i = 0; i < data[pos]; ++i)
+        {
+            counts[symbol++] = 0;
+        }
+        ++pos;
+    }
+    header_size = pos;
+
+    return true;
+}
+
+bool decode_tans_block(const uint8_t* payload, size_t payload_size, uint8_t* out, size_t out_size)
+{
+    // tables are kept per thread, so decoding a block doesn't allocate.
+    thread_local TansDecodeTable table {};
+    NormalizedCounts counts {};
+    int table_log {};
+    size_t header_size {};
+
+    if (!read_normalized_counts(payload, payload_size, counts, table_log, header_size))
+    {
+        std::cerr << "Error: block header is truncated.\n";
+        return false;
+    }
+    if (!table.build(counts, table_log))
     {
-        infile.read(reinterpret_cast<char*>(&current_byte), 1);
+        std::cerr << "Error: counts in block header do not fill the tANS table.\n";
+        return false;
+    }
 
-        // we want to read the byte bit by bit from the left most bit. 
-        // since we are reading in chunks by bytes, we need to keep track of the 
-        // remaining bits so as not to over read.
-        remaining_bits_per_byte = std::min(remaining_bits, 8);
+    // the stream must end in the last byte of the payload, only padding may follow.
+    BitReader reader { payload + header_size, payload_size - header_size };
+    if (!table.decode(reader, out, out_size) || (reader.bits_consumed() + 7) / 8 != payload_size - header_size)
+    {
+        std::cerr << "Error: failure at converting encoded block to decoded text.\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool decode_body_w_decode_table(const uint8_t* body, size_t body_size, const HuffmanDecodeTable& table, uint8_t* out, size_t out_size)
+{
+    const HuffmanDecodeEntry* primary { table.primary() };
+    const HuffmanDecodeEntry* secondary { table.secondary() };
+    BitReader reader { body, body_size };
 
-        for (int i = 7; i >= 8 - remaining_bits_per_byte; --i) 
+    for (size_t i = 0; i < out_size; ++i)
+    {
+        if (!decode_symbol(reader, primary, secondary, out[i]))
         {
-            code_string += ((current_byte >> i) & 1) ? '1' : '0';
-            --remaining_bits;
+            return false;
         }
     }
 
-    if (infile.bad())
+    // the last code must end in the last byte of the body, only padding may follow.
+    return (reader.bits_consumed() + 7) / 8 == body_size;
+}
+
+bool decode_streams_w_decode_table(const uint8_t* body, size_t body_size, const HuffmanDecodeTable& table, uint8_t* out, size_t out_size)
+{
+    const HuffmanDecodeEntry* primary { table.primary() };
+    const HuffmanDecodeEntry* secondary { table.secondary() };
+
+    // the stream table gives the sizes of all streams but the last, which takes 
+    // the rest of the body.
+    if (body_size < STREAM_TABLE_SIZE)
     {
         return false;
     }
+    std::array<size_t, STREAM_COUNT> sizes {};
+    size_t streams_size { 0 };
+    for (int stream = 0; stream + 1 < STREAM_COUNT; ++stream)
+    {
+        sizes[stream] = load_u32(body + 4 * stream);
+        streams_size += sizes[stream];
+    }
+    if (streams_size > body_size - STREAM_TABLE_SIZE)
+    {
+        return false;
+    }
+    sizes[STREAM_COUNT - 1] = body_size - STREAM_TABLE_SIZE - streams_size;
+
+    const uint8_t* data { body + STREAM_TABLE_SIZE };
+    std::array<BitReader, STREAM_COUNT> readers { BitReader { data, sizes[0] }, 
+                                                  BitReader { data + sizes[0], sizes[1] },
+                                                  BitReader { data + sizes[0] + sizes[1], sizes[2] },
+                                                  BitReader { data + sizes[0] + sizes[1] + sizes[2], sizes[3] } };
+
+    // the four readers carry no dependencies between each other, so their 
+    // lookups overlap instead of waiting on one another.
+    bool ok { true };
+    size_t i { 0 };
+    for (; i + STREAM_COUNT <= out_size; i += STREAM_COUNT)
+    {
+        ok &= decode_symbol(readers[0], primary, secondary, out[i]);
+        ok &= decode_symbol(readers[1], primary, secondary, out[i + 1]);
+        ok &= decode_symbol(readers[2], primary, secondary, out[i + 2]);
+        ok &= decode_symbol(readers[3], primary, secondary, out[i + 3]);
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    for (int stream = 0; i < out_size; ++i, ++stream)
+    {
+        if (!decode_symbol(readers[stream], primary, secondary, out[i]))
+        {
+            return false;
+        }
+    }
+
+    // every stream must end in its last byte, only padding may follow.
+    for (int stream = 0; stream < STREAM_COUNT; ++stream)
+    {
+        if ((readers[stream].bits_consumed() + 7) / 8 != sizes[stream])
+        {
+            return false;
+        }
+    }
 
     return true;
 }
 
-bool read_header_from_compressed_file(std::ifstream& infile, std::unordered_map<char, std::string>& prefix_table)
+bool decode_huffman_block(const uint8_t* payload, size_t payload_size, bool interleaved, uint8_t* out, size_t out_size)
 {
+    thread_local HuffmanDecodeTable decode_table {};
+    CodeLengths lengths {};
+    HuffmanCodeTable codes {};
+    size_t header_size {};
     bool ok {};
 
-    // read first 16 bits where we store the number of elements in the prefix_table.
-    uint16_t header_size {};
-    infile.read(reinterpret_cast<char*>(&header_size), sizeof(header_size));
+    ok = read_code_lengths(payload, payload_size, lengths, header_size);
+    if (!ok)
+    {
+        std::cerr << "Error: block header is truncated.\n";
+        return false;
+    }
 
-    for (uint16_t i = 0; i < header_size; ++i)
+    ok = build_canonical_codes(lengths, codes) && decode_table.build(codes);
+    if (!ok)
     {
-        char ch {};
-        uint8_t prefix_code_size {};
-        std::string prefix_code {};
+        std::cerr << "Error: code lengths in block header do not form a valid prefix code.\n";
+        return false;
+    }
 
-        // read ch, prefix_code_size, and code in that order. ch is 1 byte and 
-        // code is number of bits specified in prefix_code_size
-        infile.read(&ch, 1);
-        infile.read(reinterpret_cast<char*>(&prefix_code_size), 1);
-        ok = read_code_by_bits_from_file(infile, prefix_code_size, prefix_code);
-        if (!ok)
+    const uint8_t* body { payload + header_size };
+    size_t body_size { payload_size - header_size };
+    ok = interleaved ? decode_streams_w_decode_table(body, body_size, decode_table, out, out_size)
+                     : decode_body_w_decode_table(body, body_size, decode_table, out, out_size);
+    if (!ok)
+    {
+        std::cerr << "Error: failure at converting encoded block to decoded text.\n";
+        return false;
+    }
+    
+    return true;
+}
+
+bool decode_adaptive_block(const uint8_t* payload, size_t payload_size, uint8_t* out, size_t out_size)
+{
+    AdaptiveHuffmanCoder coder {};
+    BitReader reader { payload, payload_size };
+    for (size_t i = 0; i < out_size; ++i)
+    {
+        out[i] = coder.decode(reader);
+    }
+
+    // every bit pattern decodes to something, so corruption only shows as a 
+    // stream that does not end in the last byte of the payload.
+    if ((reader.bits_consumed() + 7) / 8 != payload_size)
+    {
+        std::cerr << "Error: failure at converting encoded block to decoded text.\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool decode_context_body(const uint8_t* body, size_t body_size, const std::array<uint8_t, 256>& cluster_of, const std::vector<HuffmanDecodeTable>& tables, uint8_t* out, size_t out_size)
+{
+    // every byte picks its table by the byte before it.
+    std::array<const HuffmanDecodeTable*, 256> table_of {};
+    for (size_t context = 0; context < table_of.size(); ++context)
+    {
+        table_of[context] = &tables[cluster_of[context]];
+    }
+
+    BitReader reader { body, body_size };
+    uint8_t previous { 0 };
+    for (size_t i = 0; i < out_size; ++i)
+    {
+        const HuffmanDecodeTable& table { *table_of[previous] };
+        if (!decode_symbol(reader, table.primary(), table.secondary(), out[i]))
         {
             return false;
         }
-        prefix_table[ch] = prefix_code;
+        previous = out[i];
+    }
+
+    // the last code must end in the last byte of the body, only padding may follow.
+    return (reader.bits_consumed() + 7) / 8 == body_size;
+}
+
+bool decode_context_block(const uint8_t* payload, size_t payload_size, uint8_t* out, size_t out_size)
+{
+    thread_local ContextModel model {};
+    thread_local std::vector<HuffmanDecodeTable> tables(MAX_CONTEXT_CLUSTERS);
+    size_t header_size {};
+
+    bool ok { read_context_model(payload, payload_size, model, header_size) };
+    for (int cluster = 0; ok && cluster < model.cluster_count; ++cluster)
+    {
+        HuffmanCodeTable codes {};
+        ok = build_canonical_codes(model.lengths[cluster], codes) && tables[cluster].build(codes);
+    }
+    if (!ok)
+    {
+        std::cerr << "Error: block header is corrupt.\n";
+        return false;
     }
 
-    if (infile.bad())
+    if (!decode_context_body(payload + header_size, payload_size - header_size, model.cluster_of, tables, out, out_size))
     {
+        std::cerr << "Error: failure at converting encoded block to decoded text.\n";
         return false;
     }
 
-    return  true;
+    return true;
 }
 
-bool decode_body_w_reverse_prefix_table(const std::string& encoded_body, std::unordered_map<std::string, char> reverse_prefix_table, std::string& decoded_body)
+bool decode_dictionary_block(const uint8_t* payload, size_t payload_size, const Dictionary* dictionary, bool order1, uint8_t* out, size_t out_size)
 {
-    std::string current_code {};
-    for (auto& ch : encoded_body)
+    if (!dictionary)
+    {
+        std::cerr << "Error: block needs a dictionary the file doesn't name.\n";
+        return false;
+    }
+
+    // the dictionary's tables were built when it was loaded, every block shares them.
+    bool ok = order1 ? decode_context_body(payload, payload_size, dictionary->model().cluster_of, dictionary->cluster_tables(), out, out_size)
+                     : decode_body_w_decode_table(payload, payload_size, dictionary->decode_table(), out, out_size);
+    if (!ok)
     {
-        current_code += ch;
-        auto it { reverse_prefix_table.find(current_code) };
-        if (it == reverse_prefix_table.end()) { continue; }
-        decoded_body += it->second;
-        current_code = "";
+        std::cerr << "Error: failure at converting encoded block to decoded text.\n";
+        return false;
     }
 
     return true;
 }
 
-// TODO: clean the handling of chunk_size. 
-bool read_encoded_body_from_compressed_file(std::ifstream& infile, std::string& encoded_body)
+bool decode_block(const uint8_t* block, size_t block_size, const Dictionary* dictionary, std::vector<uint8_t>& decoded);
+
+bool decode_lz77_block(const uint8_t* payload, size_t payload_size, const Dictionary* dictionary, uint8_t* out, size_t out_size)
 {
-    bool ok {};
+    if (payload_size < 1 || payload[0] < MIN_WINDOW_BITS || payload[0] > MAX_WINDOW_BITS)
+    {
+        std::cerr << "Error: block header is corrupt.\n";
+        return false;
+    }
+    int window_bits { payload[0] };
 
-    // don't want to read the trailing 0s packed in with the last byte.
-    uint8_t trailing_bits {};
-    infile.read(reinterpret_cast<char*>(&trailing_bits), sizeof(trailing_bits));
+    // the sequence streams are nested blocks of the other methods, one after another.
+    thread_local LzStreams streams {};
+    size_t pos { 1 };
+    for (std::vector<uint8_t>* stream : { &streams.literals, &streams.tokens, &streams.offsets, &streams.lengths })
+    {
+        if (payload_size - pos < BLOCK_HEADER_SIZE || payload[pos] == static_cast<uint8_t>(BlockMethod::lz77))
+        {
+            std::cerr << "Error: block header is corrupt.\n";
+            return false;
+        }
+        size_t block_size { BLOCK_HEADER_SIZE + load_u32(payload + pos + 5) };
+        if (block_size > payload_size - pos || !decode_block(payload + pos, block_size, dictionary, *stream))
+        {
+            std::cerr << "Error: block header is corrupt.\n";
+            return false;
+        }
+        pos += block_size;
+    }
 
-    // get the byte size of the body
-    std::streampos body_start { infile.tellg() };
-    infile.seekg(0, std::ios::end);
-    std::streampos body_end { infile.tellg() };
-    infile.seekg(body_start, std::ios::beg);
+    if (pos != payload_size || !expand_sequences(streams, window_bits, out, out_size))
+    {
+        std::cerr << "Error: failure at converting encoded block to decoded text.\n";
+        return false;
+    }
 
-    // get the bit size of the body, allow narrowing conversion. Dont forget to treat 
-    // for trailing bits here. 
-    int remaining_bits = (body_end - body_start) * 8 - trailing_bits;
+    return true;
+}
 
-    // read the file chunk by chunk. This chunk must be a multiple of 8, otherwise we 
-    // end up skipping bits. We use an int type here because we want to compare with 
-    // another int type later to get the minimum. 
-    int chunk_size { 31 * 8 };
+// checks the block header against the size of the whole block and sets the size
+// it decodes to.
+bool read_block_header(const uint8_t* block, size_t block_size, uint32_t& raw_size)
+{
+    // sizes are bounded before anything is allocated, so a corrupt header can not 
+    // ask for huge buffers.
+    if (block_size < BLOCK_HEADER_SIZE)
+    {
+        std::cerr << "Error: block header is corrupt.\n";
+        return false;
+    }
+    raw_size = load_u32(block + 1);
+    uint32_t payload_size { load_u32(block + 5) };
+    BlockMethod method { block[0] };
+    bool ok = (method == BlockMethod::huffman || method == BlockMethod::huffman_streams || method == BlockMethod::adaptive_huffman
+               || method == BlockMethod::lz77 || method == BlockMethod::tans || method == BlockMethod::huffman_order1
+               || method == BlockMethod::dictionary_huffman || method == BlockMethod::dictionary_order1
+               || method == BlockMethod::stored) 
+           && raw_size <= MAX_BLOCK_SIZE 
+           && payload_size == block_size - BLOCK_HEADER_SIZE;
+    if (!ok)
+    {
+        std::cerr << "Error: block header is corrupt.\n";
+        return false;
+    }
 
-    while (remaining_bits > 0)
+    return true;
+}
+
+// decodes a block into out, which must be the size from its header. dictionary is 
+// the one the file names, if any.
+bool decode_block(const uint8_t* block, size_t block_size, const Dictionary* dictionary, uint8_t* out, size_t out_size)
+{
+    uint32_t raw_size {};
+    if (!read_block_header(block, block_size, raw_size) || raw_size != out_size)
     {
-        uint8_t bits_to_read = std::min(chunk_size, remaining_bits);
-        std::string bit_string {};
+        return false;
+    }
 
-        ok = read_code_by_bits_from_file(infile, bits_to_read, bit_string);
-        if (!ok)
+    // the block header tells the method.
+    BlockMethod method { block[0] };
+    const uint8_t* payload { block + BLOCK_HEADER_SIZE };
+    size_t payload_size { block_size - BLOCK_HEADER_SIZE };
+    if (method == BlockMethod::stored)
+    {
+        if (payload_size != out_size)
         {
+            std::cerr << "Error: block header is corrupt.\n";
             return false;
         }
+        std::memcpy(out, payload, out_size);
+        return true;
+    }
+    if (method == BlockMethod::lz77)
+    {
+        return decode_lz77_block(payload, payload_size, dictionary, out, out_size);
+    }
+    if (method == BlockMethod::dictionary_huffman || method == BlockMethod::dictionary_order1)
+    {
+        return decode_dictionary_block(payload, payload_size, dictionary, method == BlockMethod::dictionary_order1, out, out_size);
+    }
+    if (method == BlockMethod::huffman_order1)
+    {
+        return decode_context_block(payload, payload_size, out, out_size);
+    }
+    if (method == BlockMethod::tans)
+    {
+        return decode_tans_block(payload, payload_size, out, out_size);
+    }
+    if (method == BlockMethod::adaptive_huffman)
+    {
+        return decode_adaptive_block(payload, payload_size, out, out_size);
+    }
+    bool interleaved { method == BlockMethod::huffman_streams };
+    return decode_huffman_block(payload, payload_size, interleaved, out, out_size);
+}
+
+bool decode_block(const uint8_t* block, size_t block_size, const Dictionary* dictionary, std::vector<uint8_t>& decoded)
+{
+    uint32_t raw_size {};
+    if (!read_block_header(block, block_size, raw_size))
+    {
+        return false;
+    }
+
+    decoded.resize(raw_size);
+    return decode_block(block, block_size, dictionary, decoded.data(), decoded.size());
+}
+
+// checks the fixed part of the file header and sets the size of the whole header.
+bool check_file_header(const uint8_t* header, size_t size, size_t& header_size)
+{
+    if (size < FILE_HEADER_SIZE || std::memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        std::cerr << "Error: not a jzip file.\n";
+        return false;
+    }
+    if (header[sizeof(FILE_MAGIC)] != FORMAT_VERSION || (header[sizeof(FILE_MAGIC) + 1] & ~FLAG_DICTIONARY) != 0)
+    {
+        std::cerr << "Error: unsupported jzip format version.\n";
+        return false;
+    }
+    header_size = file_header_size(header[sizeof(FILE_MAGIC) + 1]);
+
+    return true;
+}
 
-        encoded_body += bit_string;
-        remaining_bits -= bits_to_read;
+// picks the dictionary for the blocks of a file from the rest of its header: 
+// options.dictionary when the file names it, none when it names none.
+bool check_file_dictionary(const uint8_t* header, size_t header_size, const DecompressOptions& options, const Dictionary*& dictionary)
+{
+    dictionary = nullptr;
+    if (header_size == FILE_HEADER_SIZE)
+    {
+        return true;
+    }
+
+    uint32_t id { load_u32(header + FILE_HEADER_SIZE) };
+    if (!options.dictionary)
+    {
+        std::cerr << "Error: file was compressed with dictionary " << id << ", which is needed to decompress it.\n";
+        return false;
+    }
+    if (options.dictionary->id() != id)
+    {
+        std::cerr << "Error: file was compressed with dictionary " << id << ", not " << options.dictionary->id() << ".\n";
+        return false;
+    }
+    dictionary = options.dictionary;
+
+    return true;
+}
+
+bool read_file_header(InputSource& input, const DecompressOptions& options, size_t& header_size, const Dictionary*& dictionary)
+{
+    uint8_t header[FILE_HEADER_SIZE + DICTIONARY_ID_SIZE] {};
+    size_t read {};
+    bool ok = input.read(header, FILE_HEADER_SIZE, read) && check_file_header(header, read, header_size);
+    if (!ok)
+    {
+        return false;
+    }
+    // the dictionary ID follows the fixed part.
+    size_t rest_size { header_size - FILE_HEADER_SIZE };
+    if (rest_size > 0 && (!input.read(header + FILE_HEADER_SIZE, rest_size, read) || read != rest_size))
+    {
+        std::cerr << "Error: compressed file is truncated.\n";
+        return false;
+    }
+
+    return check_file_dictionary(header, header_size, options, dictionary);
+}
+
+bool read_block_index(const uint8_t* file, uint64_t file_size, size_t header_size, std::vector<BlockIndexEntry>& index, bool& has_index)
+{
+    // files that end in the end marker have no index.
+    has_index = file_size > header_size && file[file_size - 1] != static_cast<uint8_t>(BlockMethod::end);
+    if (!has_index || file_size < header_size + 1 + FOOTER_SIZE)
+    {
+        return !has_index;
     }
 
-    ok = !infile.bad();
+    const uint8_t* footer { file + file_size - FOOTER_SIZE };
+    uint64_t block_count { load_u64(footer) };
+    uint64_t index_offset { load_u64(footer + 8) };
+    // compared by subtracting from the file size, which can't wrap around the 
+    // way adding up huge values from a corrupt footer can.
+    uint64_t index_space { file_size - FOOTER_SIZE };
+    bool ok = std::memcmp(footer + 16, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0
+           && block_count <= index_space / INDEX_ENTRY_SIZE 
+           && index_offset == index_space - block_count * INDEX_ENTRY_SIZE
+           && index_offset > header_size;
     if (!ok)
     {
-        std::cerr << "Error: input file is broken.\n";
         return false;
     }
 
+    // blocks must follow each other without gaps, from the file header up to the 
+    // end marker right before the index.
+    uint64_t offset { header_size };
+    uint64_t raw_offset { 0 };
+    index.resize(block_count);
+    for (uint64_t i = 0; i < block_count; ++i)
+    {
+        const uint8_t* data { file + index_offset + i * INDEX_ENTRY_SIZE };
+        BlockIndexEntry& entry { index[i] };
+        entry.offset = load_u64(data);
+        entry.size = load_u32(data + 8);
+        entry.raw_size = load_u32(data + 12);
+        entry.raw_offset = raw_offset;
+        if (entry.offset != offset || entry.size < BLOCK_HEADER_SIZE || entry.size >= index_offset - offset || entry.raw_size > MAX_BLOCK_SIZE)
+        {
+            return false;
+        }
+        offset += entry.size;
+        raw_offset += entry.raw_size;
+    }
+
+    return offset + 1 == index_offset;
+}
+
+bool scan_block_index(const uint8_t* file, uint64_t file_size, size_t header_size, std::vector<BlockIndexEntry>& index)
+{
+    // without a stored index, the block headers are enough to rebuild it. Only 
+    // the headers are looked at, payloads are skipped over.
+    uint64_t offset { header_size };
+    uint64_t raw_offset { 0 };
+    index.clear();
+
+    while (true)
+    {
+        if (offset >= file_size)
+        {
+            return false;
+        }
+        if (file[offset] == static_cast<uint8_t>(BlockMethod::end))
+        {
+            break;
+        }
+        if (file_size - offset < BLOCK_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        const uint8_t* header { file + offset };
+        BlockIndexEntry entry { offset, 0, load_u32(header + 1), raw_offset };
+        uint64_t payload_size { load_u32(header + 5) };
+        if (entry.raw_size > MAX_BLOCK_SIZE || payload_size > max_payload_size(entry.raw_size))
+        {
+            return false;
+        }
+        entry.size = BLOCK_HEADER_SIZE + payload_size;
+        index.push_back(entry);
+        offset += entry.size;
+        raw_offset += entry.raw_size;
+    }
+
+    return true;
+}
+
+bool load_block_index(const uint8_t* file, uint64_t file_size, size_t header_size, std::vector<BlockIndexEntry>& index)
+{
+    bool has_index {};
+    bool ok = read_block_index(file, file_size, header_size, index, has_index) 
+           && (has_index || scan_block_index(file, file_size, header_size, index));
+    if (!ok)
+    {
+        std::cerr << "Error: block index is corrupt.\n";
+        return false;
+    }
+
+    return true;
+}
+
+// decodes the block in place in the mapped file. The index entries have been 
+// checked against the file size, so the block is entirely inside it.
+bool decode_indexed_block(const uint8_t* file, const BlockIndexEntry& entry, const Dictionary* dictionary, std::vector<uint8_t>& decoded, Stats* stats)
+{
+    PhaseTimer timer { stats, Phase::decode };
+    const uint8_t* block { file + entry.offset };
+    bool ok = load_u32(block + 1) == entry.raw_size && decode_block(block, entry.size, dictionary, decoded);
+    if (!ok)
+    {
+        std::cerr << "Error: failed to read block at offset " << entry.offset << " from compressed file.\n";
+        return false;
+    }
+    if (stats)
+    {
+        stats->add_block(block[0], entry.raw_size, entry.size);
+    }
+
+    return true;
+}
+
+// writes all of data at offset, which a signal or a full disk may split up.
+bool write_at(int fd, const uint8_t* data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t written { pwrite(fd, data, size, offset) };
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
     return true;
 }
 
-// would it be faster to use the reversed map, versus searching the prefix code tree?
-// both are linear but tree construction from header is cumbersome.
-bool read_decoded_body_from_compressed_file(std::ifstream& infile, const std::unordered_map<char, std::string>& prefix_table, std::string& decoded_body)
+// decodes the indexed blocks in parallel, and each decoding thread writes its 
+// block into its region of the output file with a positioned write, so blocks 
+// finish in any order without taking turns on a lock. A ring of jobs bounds the 
+// number in flight, like the pipeline of the ordered paths.
+bool decompress_indexed_blocks(const uint8_t* file, int fd, const std::vector<BlockIndexEntry>& index, const Dictionary* dictionary, 
+                               ThreadPool& pool, Stats* stats)
+{
+    // size the output up front, so no write has to extend the file.
+    uint64_t output_size { index.empty() ? 0 : index.back().raw_offset + index.back().raw_size };
+    if (ftruncate(fd, output_size) != 0)
+    {
+        std::cerr << "Error: failed to size the output file to " << output_size << " bytes.\n";
+        return false;
+    }
+
+    struct IndexedJob
+    {
+        Stats stats {};
+        std::future<bool> done {};
+    };
+
+    // a job's stats are added up on this thread once its slot comes round again.
+    std::vector<IndexedJob> jobs(2 * static_cast<size_t>(pool.size()));
+    bool ok { true };
+    auto finish_job { [&](IndexedJob& job)
+    {
+        if (job.done.valid())
+        {
+            ok = job.done.get() && ok;
+            if (stats)
+            {
+                stats->add(job.stats);
+            }
+        }
+    } };
+
+    for (size_t i = 0; i < index.size() && ok; ++i)
+    {
+        IndexedJob& job { jobs[i % jobs.size()] };
+        finish_job(job);
+        job.stats = {};
+        job.done = pool.submit([&, &entry = index[i], &job = job]() 
+        { 
+            // buffers are kept per thread and reused for every block the thread decodes.
+            thread_local std::vector<uint8_t> decoded {};
+            Stats* block_stats { stats ? &job.stats : nullptr };
+            if (!decode_indexed_block(file, entry, dictionary, decoded, block_stats))
+            {
+                return false;
+            }
+
+            PhaseTimer timer { block_stats, Phase::write };
+            if (!write_at(fd, decoded.data(), decoded.size(), entry.raw_offset))
+            {
+                std::cerr << "Error: failed to write the block at offset " << entry.raw_offset << " of the output file.\n";
+                return false;
+            }
+            if (block_stats)
+            {
+                block_stats->output_bytes = decoded.size();
+            }
+            return true;
+        });
+    }
+    for (IndexedJob& job : jobs)
+    {
+        finish_job(job);
+    }
+
+    return ok;
+}
+
+// decodes the indexed blocks overlapping [offset, end) of the decompressed data 
+// in parallel and writes that part of them out in order, with a bounded number 
+// in flight.
+bool decompress_ordered_blocks(const uint8_t* file, std::ostream& out, const std::vector<BlockIndexEntry>& index, uint64_t offset, uint64_t end, 
+                               const Dictionary* dictionary, ThreadPool& pool, Stats* stats)
 {
-    std::unordered_map<std::string, char> reverse_prefix_table { reverse_map(prefix_table) };
-    std::string encoded_body {};
+    auto first { std::upper_bound(index.begin(), index.end(), offset, 
+        [](uint64_t value, const BlockIndexEntry& entry) { return value < entry.raw_offset + entry.raw_size; }) };
+    auto last { std::lower_bound(first, index.end(), end, 
+        [](const BlockIndexEntry& entry, uint64_t value) { return entry.raw_offset < value; }) };
+
+    struct OrderedJob
+    {
+        const BlockIndexEntry* entry {};
+        std::vector<uint8_t> decoded {};
+        Stats stats {};
+        std::future<bool> done {};
+    };
+
+    // only the overlapping part of the first and last block is written.
+    BlockPipeline<OrderedJob> pipeline { 2 * static_cast<size_t>(pool.size()), [&](OrderedJob& job)
+    {
+        PhaseTimer timer { stats, Phase::write };
+        const BlockIndexEntry& entry { *job.entry };
+        uint64_t slice_start { std::max(offset, entry.raw_offset) - entry.raw_offset };
+        uint64_t slice_end { std::min(end, entry.raw_offset + entry.raw_size) - entry.raw_offset };
+        out.write(reinterpret_cast<const char*>(job.decoded.data() + slice_start), slice_end - slice_start);
+        if (stats)
+        {
+            stats->add(job.stats);
+            stats->input_bytes += entry.size;
+            stats->output_bytes += slice_end - slice_start;
+        }
+        return !out.bad();
+    } };
+
+    for (auto entry = first; entry != last; ++entry)
+    {
+        OrderedJob* job { pipeline.next() };
+        if (!job)
+        {
+            break;
+        }
+        job->entry = &*entry;
+        job->stats = {};
+        job->done = pool.submit([&, job]() { return decode_indexed_block(file, *job->entry, dictionary, job->decoded, stats ? &job->stats : nullptr); });
+        pipeline.submit();
+    }
+
+    return pipeline.finish();
+}
+
+// reads the next block in the input into block, header included. Sets at_end 
+// instead when the next thing in the input is the end marker.
+bool read_next_block(InputSource& input, std::vector<uint8_t>& block, bool& at_end)
+{
+    size_t read {};
+
+    block.resize(BLOCK_HEADER_SIZE);
+    if (!input.read(block.data(), 1, read) || read != 1)
+    {
+        std::cerr << "Error: compressed file is truncated.\n";
+        return false;
+    }
+    at_end = block[0] == static_cast<uint8_t>(BlockMethod::end);
+    if (at_end)
+    {
+        return true;
+    }
+
+    bool ok = input.read(block.data() + 1, BLOCK_HEADER_SIZE - 1, read) && read == BLOCK_HEADER_SIZE - 1;
+    uint32_t payload_size { load_u32(block.data() + 5) };
+    if (!ok || payload_size > max_payload_size(load_u32(block.data() + 1)))
+    {
+        std::cerr << "Error: block header is corrupt.\n";
+        return false;
+    }
+
+    block.resize(BLOCK_HEADER_SIZE + payload_size);
+    if (!input.read(block.data() + BLOCK_HEADER_SIZE, payload_size, read) || read != payload_size)
+    {
+        std::cerr << "Error: compressed file is truncated.\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool decompress_sequential_blocks(InputSource& input, std::ostream& outfile, const Dictionary* dictionary, ThreadPool& pool, Stats* stats)
+{
+    struct SequentialJob
+    {
+        std::vector<uint8_t> block {};
+        std::vector<uint8_t> decoded {};
+        Stats stats {};
+        std::future<bool> done {};
+    };
+
+    // blocks are read in order on this thread, decoded in parallel and written in 
+    // order by the pipeline's writer, with a bounded number in flight. This works 
+    // on pipes on either side.
+    // the reader keeps stats of its own, added once the writer is done.
+    Stats read_stats {};
+    BlockPipeline<SequentialJob> pipeline { 2 * static_cast<size_t>(pool.size()), [&](SequentialJob& job)
+    {
+        PhaseTimer timer { stats, Phase::write };
+        outfile.write(reinterpret_cast<const char*>(job.decoded.data()), job.decoded.size());
+        if (stats)
+        {
+            stats->add(job.stats);
+            stats->output_bytes += job.decoded.size();
+        }
+        return !outfile.bad();
+    } };
+
+    bool ok { true };
+    while (SequentialJob* job = pipeline.next())
+    {
+        PhaseTimer timer { stats ? &read_stats : nullptr, Phase::read };
+        bool at_end {};
+        ok = read_next_block(input, job->block, at_end);
+        if (!ok || at_end)
+        {
+            break;
+        }
+        read_stats.input_bytes += job->block.size();
+        job->stats = {};
+        job->done = pool.submit([job, dictionary, stats]()
+        {
+            PhaseTimer timer { stats ? &job->stats : nullptr, Phase::decode };
+            if (!decode_block(job->block.data(), job->block.size(), dictionary, job->decoded))
+            {
+                std::cerr << "Error: failed to read block from compressed file.\n";
+                return false;
+            }
+            job->stats.add_block(job->block[0], job->decoded.size(), job->block.size());
+            return true;
+        });
+        pipeline.submit();
+    }
+
+    ok = pipeline.finish() && ok;
+    if (stats)
+    {
+        // the end marker was read too.
+        read_stats.input_bytes += 1;
+        stats->add(read_stats);
+    }
+
+    return ok;
+}
+
+bool decompress_range(InputSource& input, std::ostream& out, uint64_t offset, uint64_t length, const DecompressOptions& options)
+{
+    std::vector<BlockIndexEntry> index {};
+    size_t header_size {};
+    const Dictionary* dictionary {};
     bool ok {};
 
-    ok = read_encoded_body_from_compressed_file(infile, encoded_body);
+    ok = read_file_header(input, options, header_size, dictionary);
+    if (!ok) 
+    {
+        return false;
+    }
+
+    if (!input.is_mapped())
+    {
+        std::cerr << "Error: extracting a range needs a regular file as input.\n";
+        return false;
+    }
+
+    ok = load_block_index(input.data(), input.size(), header_size, index);
     if (!ok)
     {
-        std::cerr << "Error: failure at retrieving encoded body from input file.\n";
         return false;
     }
 
-    ok = decode_body_w_reverse_prefix_table(encoded_body, reverse_prefix_table, decoded_body);
+    uint64_t decoded_size { index.empty() ? 0 : index.back().raw_offset + index.back().raw_size };
+    if (offset > decoded_size)
+    {
+        std::cerr << "Error: range starts past the end of the decompressed data (" << decoded_size << " bytes).\n";
+        return false;
+    }
+    uint64_t end { offset + std::min(length, decoded_size - offset) };
+
+    // only the blocks overlapping the range are decoded.
+    ThreadPool pool { options.threads > 0 ? options.threads : default_thread_count() };
+    ok = decompress_ordered_blocks(input.data(), out, index, offset, end, dictionary, pool, options.stats) && !out.bad();
     if (!ok)
     {
-        std::cerr << "Error: failure at converting encoded body to decoded text.\n";
+        std::cerr << "Error: failed to extract range from compressed file.\n";
         return false;
     }
-    
+
     return true;
 }
 
 // writes decompressed file to output file.
-bool decompress_file(std::ifstream& infile, std::ofstream& outfile)
+bool decompress_file(InputSource& input, std::ostream& outfile, const DecompressOptions& options)
+{
+    ThreadPool pool { options.threads > 0 ? options.threads : default_thread_count() };
+    return decompress_file(input, outfile, options, pool);
+}
+
+bool decompress_file(InputSource& input, std::ostream& outfile, const DecompressOptions& options, ThreadPool& pool)
 {
-    std::unordered_map<char, std::string> prefix_table {};
-    std::string decoded_body {};
+    std::vector<BlockIndexEntry> index {};
+    size_t header_size {};
+    const Dictionary* dictionary {};
     bool ok {};
 
-    ok = read_header_from_compressed_file(infile, prefix_table);
+    ok = read_file_header(input, options, header_size, dictionary);
     if (!ok) 
     {
-        std::cerr << "Error: failed to read header from compressed file.\n";
         return false;
     }
 
-    ok = read_decoded_body_from_compressed_file(infile, prefix_table, decoded_body);
+    // the whole file is counted as input once the blocks are done.
+    Stats file_stats {};
+    Stats* stats { options.stats ? &file_stats : nullptr };
+
+    // a mapped input has every block in place, so they are located through the 
+    // index and decoded without copying, then written in order. Inputs that 
+    // can't be mapped, like pipes, are read block by block.
+    if (input.is_mapped())
+    {
+        ok = load_block_index(input.data(), input.size(), header_size, index);
+        if (!ok)
+        {
+            return false;
+        }
+
+        ok = decompress_ordered_blocks(input.data(), outfile, index, 0, UINT64_MAX, dictionary, pool, stats);
+        file_stats.input_bytes = input.size();
+    }
+    else
+    {
+        ok = decompress_sequential_blocks(input, outfile, dictionary, pool, stats);
+        file_stats.input_bytes += header_size;
+    }
+    if (stats)
+    {
+        options.stats->add(file_stats);
+    }
+    if (!ok)
+    {
+        return false;
+    }
+
+    ok = !outfile.bad();
+    if (!ok)
+    {
+        std::cerr << "Error: output file is corrupt.\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool decompress_file(InputSource& input, const std::string& output_path, const DecompressOptions& options)
+{
+    ThreadPool pool { options.threads > 0 ? options.threads : default_thread_count() };
+    return decompress_file(input, output_path, options, pool);
+}
+
+bool decompress_file(InputSource& input, const std::string& output_path, const DecompressOptions& options, ThreadPool& pool)
+{
+    if (!input.is_mapped())
+    {
+        std::ofstream outfile { output_path, std::ios::out | std::ios::binary | std::ios::trunc };
+        bool ok { decompress_file(input, outfile, options, pool) };
+        outfile.close();
+        if (ok && outfile.fail())
+        {
+            std::cerr << "Error: failed to write " << output_path << ".\n";
+            return false;
+        }
+        return ok;
+    }
+
+    std::vector<BlockIndexEntry> index {};
+    size_t header_size {};
+    const Dictionary* dictionary {};
+    bool ok = read_file_header(input, options, header_size, dictionary) 
+           && load_block_index(input.data(), input.size(), header_size, index);
     if (!ok) 
     {
-        std::cerr << "Error: failed to read body from compressed file.\n";
         return false;
     }
 
-    outfile << decoded_body;
+    int fd { open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) };
+    if (fd < 0)
+    {
+        std::cerr << "Error: file " << output_path << " could not be created.\n";
+        return false;
+    }
 
-    ok = !infile.bad() && !outfile.bad();
-    if (!ok)
+    Stats file_stats {};
+    ok = decompress_indexed_blocks(input.data(), fd, index, dictionary, pool, options.stats ? &file_stats : nullptr);
+    if (close(fd) != 0 && ok)
+    {
+        std::cerr << "Error: failed to write " << output_path << ".\n";
+        ok = false;
+    }
+    if (options.stats)
+    {
+        file_stats.input_bytes = input.size();
+        options.stats->add(file_stats);
+    }
+
+    return ok;
+}
+
+DecompressContext::DecompressContext(const Dictionary* dictionary)
+{
+    m_options.dictionary = dictionary;
+}
+
+bool DecompressContext::decompressed_size(const uint8_t* in, size_t in_size, uint64_t& size)
+{
+    size_t header_size {};
+    if (!check_file_header(in, in_size, header_size))
+    {
+        return false;
+    }
+    if (in_size < header_size)
+    {
+        std::cerr << "Error: compressed file is truncated.\n";
+        return false;
+    }
+    if (!check_file_dictionary(in, header_size, m_options, m_dictionary) || !load_block_index(in, in_size, header_size, m_index))
     {
-        std::cerr << "Error: input or output files are corrupt.\n";
         return false;
     }
 
+    size = m_index.empty() ? 0 : m_index.back().raw_offset + m_index.back().raw_size;
     return true;
-}
\ No newline at end of file
+}
+
+bool DecompressContext::decompress(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_capacity, size_t& out_size)
+{
+    uint64_t size {};
+    out_size = 0;
+    if (!decompressed_size(in, in_size, size))
+    {
+        return false;
+    }
+    if (size > out_capacity)
+    {
+        std::cerr << "Error: decompressed data needs " << size << " bytes, the buffer holds " << out_capacity << ".\n";
+        return false;
+    }
+
+    // every block decodes straight into its place in out.
+    for (const BlockIndexEntry& entry : m_index)
+    {
+        if (!decode_block(in + entry.offset, entry.size, m_dictionary, out + entry.raw_offset, entry.raw_size))
+        {
+            std::cerr << "Error: failed to read block at offset " << entry.offset << " from compressed file.\n";
+            return false;
+        }
+    }
+    out_size = size;
+
+    return true;
+}
@@ -2,5 +2,60 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 
-bool decompress_file(std::ifstream& compressed_file, std::ofstream& output_file);
\ No newline at end of file
+#include "dictionary.h"
+#include "format.h"
+#include "input_source.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+struct DecompressOptions
+{
+    int threads {}; // 0 uses one thread per core
+    const Dictionary* dictionary {}; // for files compressed with one, see dictionary.h
+    Stats* stats {}; // counters and phase times are added to it, see stats.h
+};
+
+// writes the data to a stream in order, after anything already in it.
+bool decompress_file(InputSource& compressed_file, std::ostream& output_file, const DecompressOptions& options = {});
+
+// decodes the blocks on pool, which may be shared with other files. The calling 
+// thread must not be one of its workers.
+bool decompress_file(InputSource& compressed_file, std::ostream& output_file, const DecompressOptions& options, ThreadPool& pool);
+
+// creates or replaces the file at output_path. Blocks of a mapped input are 
+// written straight into their places in it by the threads that decode them.
+bool decompress_file(InputSource& compressed_file, const std::string& output_path, const DecompressOptions& options = {});
+bool decompress_file(InputSource& compressed_file, const std::string& output_path, const DecompressOptions& options, ThreadPool& pool);
+
+// writes length bytes of the decompressed data starting at offset, decoding only 
+// the blocks that overlap them. The range is cut short at the end of the data.
+bool decompress_range(InputSource& compressed_file, std::ostream& output, uint64_t offset, uint64_t length, const DecompressOptions& options = {});
+
+// Decompression of a jzip file held in memory into a caller's buffer. Blocks are 
+// decoded on the calling thread with tables kept per thread, and the context 
+// keeps the block index between calls, so decompressing doesn't allocate once 
+// they have grown. A context must only be used by one thread at a time. With a 
+// dictionary, the context decodes files compressed with it using the tables the 
+// dictionary built when it was loaded, so records don't pay for building them.
+class DecompressContext
+{
+private:
+    DecompressOptions m_options {};
+    const Dictionary* m_dictionary {}; // of the file being decompressed
+    std::vector<BlockIndexEntry> m_index {};
+
+public:
+    explicit DecompressContext(const Dictionary* dictionary = nullptr);
+
+    // the size of the data in, from its block index or block headers.
+    bool decompressed_size(const uint8_t* in, size_t in_size, uint64_t& size);
+
+    // decompresses in to out and sets out_size to the size of the data. Fails when
+    // it doesn't fit, which an out_capacity of decompressed_size rules out.
+    bool decompress(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_capacity, size_t& out_size);
+};
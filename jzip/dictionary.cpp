@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "format.h"
+#include "input_source.h"
+#include "dictionary.h"
+
+// FNV-1a, enough to tell dictionaries apart.
+uint32_t hash_bytes(const uint8_t* data, size_t size)
+{
+    uint32_t hash { 2166136261u };
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool Dictionary::train(const std::vector<std::vector<uint8_t>>& samples, int max_code_length)
+{
+    // every sample is counted like a block of its own, starting from context 0.
+    ByteHistogram histogram {};
+    PairHistograms pairs(256);
+    for (const std::vector<uint8_t>& sample : samples)
+    {
+        uint8_t previous { 0 };
+        for (uint8_t byte : sample)
+        {
+            ++histogram[byte];
+            ++pairs[previous][byte];
+            previous = byte;
+        }
+    }
+    if (std::all_of(histogram.begin(), histogram.end(), [](uint64_t count) { return count == 0; }))
+    {
+        std::cerr << "Error: no sample data to train a dictionary on.\n";
+        return false;
+    }
+
+    // the clusters come from the samples as they are. Then every table is fitted
+    // again with each byte counted once more, so bytes the samples lack still get
+    // a (long) code.
+    uint64_t body_bits {};
+    bool ok { build_context_model(pairs, max_code_length, m_model, body_bits) };
+    std::array<ByteHistogram, MAX_CONTEXT_CLUSTERS> cluster_histograms {};
+    for (size_t context = 0; ok && context < pairs.size(); ++context)
+    {
+        ByteHistogram& cluster_histogram { cluster_histograms[m_model.cluster_of[context]] };
+        for (size_t symbol = 0; symbol < 256; ++symbol)
+        {
+            cluster_histogram[symbol] += pairs[context][symbol];
+        }
+    }
+    for (int cluster = 0; ok && cluster < m_model.cluster_count; ++cluster)
+    {
+        for (uint64_t& count : cluster_histograms[cluster])
+        {
+            ++count;
+        }
+        ok = build_limited_code_lengths(cluster_histograms[cluster], max_code_length, m_model.lengths[cluster]);
+    }
+    for (uint64_t& count : histogram)
+    {
+        ++count;
+    }
+    ok = ok && build_limited_code_lengths(histogram, max_code_length, m_lengths);
+    if (!ok)
+    {
+        std::cerr << "Error: failed to build dictionary codes of at most " << max_code_length << " bits.\n";
+        return false;
+    }
+
+    std::vector<uint8_t> tables {};
+    write_tables(tables);
+    m_id = hash_bytes(tables.data(), tables.size());
+
+    return build_tables();
+}
+
+void Dictionary::write_tables(std::vector<uint8_t>& out) const
+{
+    write_code_lengths(out, m_lengths);
+    write_context_model(out, m_model);
+}
+
+bool Dictionary::build_tables()
+{
+    m_cluster_tables.resize(MAX_CONTEXT_CLUSTERS);
+    bool ok = build_canonical_codes(m_lengths, m_codes) && m_decode_table.build(m_codes);
+    for (int cluster = 0; ok && cluster < m_model.cluster_count; ++cluster)
+    {
+        ok = build_canonical_codes(m_model.lengths[cluster], m_cluster_codes[cluster])
+          && m_cluster_tables[cluster].build(m_cluster_codes[cluster]);
+    }
+
+    return ok;
+}
+
+void Dictionary::save(std::vector<uint8_t>& out) const
+{
+    out.insert(out.end(), std::begin(DICTIONARY_MAGIC), std::end(DICTIONARY_MAGIC));
+    out.push_back(DICTIONARY_VERSION);
+    append_u32(out, m_id);
+    write_tables(out);
+}
+
+bool Dictionary::load(const uint8_t* data, size_t size)
+{
+    constexpr size_t header_size { sizeof(DICTIONARY_MAGIC) + 1 + 4 };
+    if (size < header_size || std::memcmp(data, DICTIONARY_MAGIC, sizeof(DICTIONARY_MAGIC)) != 0)
+    {
+        std::cerr << "Error: not a jzip dictionary.\n";
+        return false;
+    }
+    if (data[sizeof(DICTIONARY_MAGIC)] != DICTIONARY_VERSION)
+    {
+        std::cerr << "Error: unsupported jzip dictionary version.\n";
+        return false;
+    }
+
+    // the tables are checked against the ID, and must give every byte a code.
+    m_id = load_u32(data + sizeof(DICTIONARY_MAGIC) + 1);
+    const uint8_t* tables { data + header_size };
+    size_t tables_size { size - header_size };
+    size_t lengths_size {};
+    size_t model_size {};
+    auto all_coded { [](const CodeLengths& lengths) { return std::find(lengths.begin(), lengths.end(), 0) == lengths.end(); } };
+    bool ok = read_code_lengths(tables, tables_size, m_lengths, lengths_size)
+           && read_context_model(tables + lengths_size, tables_size - lengths_size, m_model, model_size)
+           && lengths_size + model_size == tables_size
+           && hash_bytes(tables, tables_size) == m_id
+           && all_coded(m_lengths)
+           && std::all_of(m_model.lengths.begin(), m_model.lengths.begin() + m_model.cluster_count, all_coded)
+           && build_tables();
+    if (!ok)
+    {
+        std::cerr << "Error: dictionary is corrupt.\n";
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t Dictionary::get_order1_bit_count(const uint8_t* data, size_t size) const
+{
+    std::array<const uint8_t*, 256> lengths_of {};
+    for (size_t context = 0; context < lengths_of.size(); ++context)
+    {
+        lengths_of[context] = m_model.lengths[m_model.cluster_of[context]].data();
+    }
+
+    uint64_t bit_count { 0 };
+    uint8_t previous { 0 };
+    for (size_t i = 0; i < size; ++i)
+    {
+        bit_count += lengths_of[previous][data[i]];
+        previous = data[i];
+    }
+
+    return bit_count;
+}
+
+bool read_dictionary_file(const std::string& path, Dictionary& dictionary)
+{
+    InputSource input {};
+    std::vector<uint8_t> buffer {};
+    const uint8_t* data {};
+    size_t size {};
+    if (!input.open(path) || !input.read_span(SIZE_MAX, buffer, data, size))
+    {
+        std::cerr << "Error: dictionary " << path << " could not be read.\n";
+        return false;
+    }
+
+    return dictionary.load(data, size);
+}
+
+bool write_dictionary_file(const std::string& path, const Dictionary& dictionary)
+{
+    std::vector<uint8_t> data {};
+    dictionary.save(data);
+
+    std::ofstream file { path, std::ios::out | std::ios::binary | std::ios::trunc };
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    file.close();
+    if (file.fail())
+    {
+        std::cerr << "Error: failed to write dictionary " << path << ".\n";
+        return false;
+    }
+
+    return true;
+}
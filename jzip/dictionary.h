@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "context_model.h"
+#include "huffman.h"
+
+// Code tables trained ahead of time on sample data. A file compressed with a
+// dictionary names it by ID in its header, and its dictionary blocks carry no
+// tables of their own, which is what makes small records worth compressing. Every
+// byte value has a code, so any data can be coded with the tables, if not well.
+//
+//   dictionary file: "JZDC" | version (u8) | id (u32) | code lengths | context model
+//
+// The code lengths are the order-0 table, the context model (see context_model.h)
+// the order-1 tables. Both are stored as in block headers. The ID is a hash of the
+// tables, so a file can't silently be decoded with the wrong dictionary.
+
+constexpr char DICTIONARY_MAGIC[4] { 'J', 'Z', 'D', 'C' };
+constexpr uint8_t DICTIONARY_VERSION { 1 };
+
+class Dictionary
+{
+private:
+    uint32_t m_id {};
+    CodeLengths m_lengths {};
+    ContextModel m_model {};
+
+    // built once from the lengths, then shared by every block and thread.
+    HuffmanCodeTable m_codes {};
+    std::array<HuffmanCodeTable, MAX_CONTEXT_CLUSTERS> m_cluster_codes {};
+    HuffmanDecodeTable m_decode_table {};
+    std::vector<HuffmanDecodeTable> m_cluster_tables {};
+
+    void write_tables(std::vector<uint8_t>& out) const;
+    bool build_tables();
+
+public:
+    // builds the tables from the byte statistics of samples. Codes are at most
+    // max_code_length bits.
+    bool train(const std::vector<std::vector<uint8_t>>& samples, int max_code_length);
+
+    void save(std::vector<uint8_t>& out) const;
+    bool load(const uint8_t* data, size_t size);
+
+    uint32_t id() const { return m_id; }
+    const CodeLengths& lengths() const { return m_lengths; }
+    const ContextModel& model() const { return m_model; }
+    const HuffmanCodeTable& codes() const { return m_codes; }
+    const std::array<HuffmanCodeTable, MAX_CONTEXT_CLUSTERS>& cluster_codes() const { return m_cluster_codes; }
+    const HuffmanDecodeTable& decode_table() const { return m_decode_table; }
+    const std::vector<HuffmanDecodeTable>& cluster_tables() const { return m_cluster_tables; }
+
+    // size of data coded with the order-1 tables, in bits.
+    uint64_t get_order1_bit_count(const uint8_t* data, size_t size) const;
+};
+
+bool read_dictionary_file(const std::string& path, Dictionary& dictionary);
+bool write_dictionary_file(const std::string& path, const Dictionary& dictionary);
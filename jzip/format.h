@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A .jzip file is a header followed by independently compressed blocks:
+//
+//   file header:  "JZIP" | version (u8) | flags (u8) [| dictionary id (u32)]
+//   block:        method (u8) | raw size (u32) | payload size (u32) | payload
+//   end marker:   method::end (u8)
+//   block index:  per block: file offset (u64) | block size incl. header (u32) | raw size (u32)
+//   footer:       block count (u64) | index offset (u64) | "JZIX"
+//
+// Each block carries its own code lengths, so blocks can be encoded and decoded
+// without looking at any other block. The index after the end marker lets readers
+// seek straight to any block; sequential readers stop at the end marker and never
+// need it. A file whose last byte is the end marker has no index, which writers
+// use for files of a single block where the index would only add to small
+// records. Files compressed with a dictionary (see dictionary.h) set
+// FLAG_DICTIONARY and name it by ID; their dictionary blocks depend on it, all
+// other blocks still stand alone. Integers are stored little endian.
+
+constexpr char FILE_MAGIC[4] { 'J', 'Z', 'I', 'P' };
+constexpr uint8_t FORMAT_VERSION { 2 };
+constexpr size_t FILE_HEADER_SIZE { sizeof(FILE_MAGIC) + 2 };
+constexpr uint8_t FLAG_DICTIONARY { 1 };
+constexpr size_t DICTIONARY_ID_SIZE { 4 };
+constexpr size_t BLOCK_HEADER_SIZE { 1 + 4 + 4 };
+constexpr char INDEX_MAGIC[4] { 'J', 'Z', 'I', 'X' };
+constexpr size_t INDEX_ENTRY_SIZE { 8 + 4 + 4 };
+constexpr size_t FOOTER_SIZE { 8 + 8 + sizeof(INDEX_MAGIC) };
+
+// huffman_streams blocks deal byte i to stream i % STREAM_COUNT. The sizes of all 
+// but the last stream follow the code lengths as u32s.
+constexpr int STREAM_COUNT { 4 };
+constexpr size_t STREAM_TABLE_SIZE { 4 * (STREAM_COUNT - 1) };
+
+constexpr size_t DEFAULT_BLOCK_SIZE { 1 << 20 };
+constexpr size_t MAX_BLOCK_SIZE { 1 << 28 };
+
+enum class BlockMethod : uint8_t
+{
+    huffman = 1,          // code lengths, then the canonical Huffman coded bytes
+    adaptive_huffman = 2, // adaptive Huffman coded bytes, no code lengths
+    huffman_streams = 3,  // code lengths, stream sizes, then STREAM_COUNT interleaved streams
+    lz77 = 4,             // window bits (u8), then the LZ77 sequence streams as nested blocks
+    tans = 5,             // table log (u8), normalized counts, then the tANS stream
+    huffman_order1 = 6,   // context clusters, code lengths per cluster, then the codes
+    dictionary_huffman = 7, // the bytes coded with the dictionary's order-0 codes
+    dictionary_order1 = 8,  // the bytes coded with the dictionary's order-1 codes
+    stored = 9,           // the bytes as they are, for data that doesn't compress
+    end = 0xff,
+};
+
+struct BlockIndexEntry
+{
+    uint64_t offset {};      // of the block header, from the start of the file
+    uint32_t size {};        // block header and payload
+    uint32_t raw_size {};
+    uint64_t raw_offset {};  // not stored, the sum of the raw sizes before the block
+};
+
+inline size_t file_header_size(uint8_t flags)
+{
+    return FILE_HEADER_SIZE + ((flags & FLAG_DICTIONARY) ? DICTIONARY_ID_SIZE : 0);
+}
+
+inline void append_u32(std::vector<uint8_t>& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+inline void append_u64(std::vector<uint8_t>& out, uint64_t value)
+{
+    append_u32(out, static_cast<uint32_t>(value));
+    append_u32(out, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint32_t load_u32(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8)
+         | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline uint64_t load_u64(const uint8_t* data)
+{
+    return static_cast<uint64_t>(load_u32(data)) | (static_cast<uint64_t>(load_u32(data + 4)) << 32);
+}
+
+// lz77 blocks hold their literals, tokens, offsets and lengths streams, in that
+// order, as complete blocks coded with one of the other methods.
+constexpr int LZ_STREAM_COUNT { 4 };
+
+// huffman_order1 blocks have up to this many code length tables.
+constexpr int MAX_CLUSTER_TABLES { 16 };
+
+// upper bound on the payload of a block holding raw_size bytes: codes of at most 
+// MAX_CODE_LENGTH (32) bits per byte plus, for each nested lz77 stream, a block 
+// header, the largest table header and padding.
+inline size_t max_payload_size(size_t raw_size)
+{
+    constexpr size_t max_header_size { 1 + 2 * 256 + MAX_CLUSTER_TABLES * 2 * 256 };
+    return 1 + 4 * raw_size + LZ_STREAM_COUNT * (BLOCK_HEADER_SIZE + max_header_size + STREAM_COUNT * 8);
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "histogram.h"
+
+void count_bytes(const uint8_t* data, size_t size, ByteHistogram& histogram)
+{
+    // a single table stalls on runs of the same byte: every increment has to wait 
+    // for the store of the previous one to the same counter. Spreading consecutive 
+    // bytes over four tables lets the increments overlap.
+    uint64_t counts[4][256] {};
+    size_t i { 0 };
+
+    // bytes are loaded a word at a time and picked apart with shifts, which is 
+    // cheaper than eight separate byte loads.
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word {};
+        std::memcpy(&word, data + i, sizeof(word));
+        ++counts[0][word & 0xff];
+        ++counts[1][(word >> 8) & 0xff];
+        ++counts[2][(word >> 16) & 0xff];
+        ++counts[3][(word >> 24) & 0xff];
+        ++counts[0][(word >> 32) & 0xff];
+        ++counts[1][(word >> 40) & 0xff];
+        ++counts[2][(word >> 48) & 0xff];
+        ++counts[3][word >> 56];
+    }
+    for (; i < size; ++i)
+    {
+        ++counts[0][data[i]];
+    }
+
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        histogram[symbol] += counts[0][symbol] + counts[1][symbol] + counts[2][symbol] + counts[3][symbol];
+    }
+}
+
+int count_symbols(const ByteHistogram& histogram)
+{
+    return std::count_if(histogram.begin(), histogram.end(), [](uint64_t count) { return count > 0; });
+}
+
+double get_entropy_bits(const ByteHistogram& histogram)
+{
+    // sum of count * log2(total / count), as total * log2(total) less the 
+    // count * log2(count) of each byte.
+    uint64_t total { 0 };
+    double bits { 0.0 };
+    for (uint64_t count : histogram)
+    {
+        if (count > 0)
+        {
+            total += count;
+            bits -= count * std::log2(static_cast<double>(count));
+        }
+    }
+
+    return total > 0 ? bits + total * std::log2(static_cast<double>(total)) : 0.0;
+}
+
+const ByteHistogram& bound_histogram(const ByteHistogram& histogram, uint64_t max_total, ByteHistogram& scaled)
+{
+    uint64_t total { 0 };
+    for (uint64_t count : histogram)
+    {
+        total = count > UINT64_MAX - total ? UINT64_MAX : total + count;
+    }
+    if (total <= max_total)
+    {
+        return histogram;
+    }
+
+    // rounding a count up to 1 adds at most one per byte value, which the shift 
+    // leaves room for.
+    int shift { 0 };
+    while (shift < 64 && (total >> shift) > max_total - histogram.size())
+    {
+        ++shift;
+    }
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        scaled[symbol] = histogram[symbol] > 0 ? std::max<uint64_t>(1, histogram[symbol] >> shift) : 0;
+    }
+
+    return scaled;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// number of occurrences of every byte value.
+using ByteHistogram = std::array<uint64_t, 256>;
+
+// counts that codes are built from are kept to this total, so the sums and 
+// products of code construction can't overflow however much input was counted.
+constexpr uint64_t MAX_CODE_TOTAL { uint64_t { 1 } << 32 };
+
+// adds the bytes in data to histogram.
+void count_bytes(const uint8_t* data, size_t size, ByteHistogram& histogram);
+
+// number of distinct byte values in histogram.
+int count_symbols(const ByteHistogram& histogram);
+
+// the order-0 entropy of the counted bytes in bits, the least any code that looks
+// at single bytes can take for them.
+double get_entropy_bits(const ByteHistogram& histogram);
+
+// the counts of histogram halved as often as needed to total at most max_total, 
+// with every counted byte kept at 1 or more. Returns histogram itself when it is 
+// already small enough, otherwise scaled, which is filled in.
+const ByteHistogram& bound_histogram(const ByteHistogram& histogram, uint64_t max_total, ByteHistogram& scaled);
@@ -1,6 +1,4 @@
-#include <memory>
-#include <map>
-#include <queue>
+#include <algorithm>
 #include <iostream>
 
 #include "huffman.h"
@@ -8,143 +6,153 @@
 /* HuffmanTreeNode */
 
 // leaf node constructor 
-HuffmanTreeNode::HuffmanTreeNode(char ch, int weight)
-    : m_char { ch }
-    , m_weight { weight }
+HuffmanTreeNode::HuffmanTreeNode(char ch, uint64_t weight)
+    : m_weight { weight }
+    , m_char { ch }
 {
 }
 
 // internal node constructor
-HuffmanTreeNode::HuffmanTreeNode(std::shared_ptr<HuffmanTreeNode> left, std::shared_ptr<HuffmanTreeNode> right)
-    : m_left { left }
-    , m_right { right }
+HuffmanTreeNode::HuffmanTreeNode(int left, int right, uint64_t weight)
+    : m_weight { weight }
+    , m_left { static_cast<int16_t>(left) }
+    , m_right { static_cast<int16_t>(right) }
 {
-    m_weight = m_left->get_weight() + m_right->get_weight();
 }
 
-int HuffmanTreeNode::get_weight() const
+uint64_t HuffmanTreeNode::get_weight() const
 {
     return m_weight;
 }
 
 char HuffmanTreeNode::get_char() const
 {
-    return m_char ? m_char : '\0';
+    return m_char;
 }
 
 bool HuffmanTreeNode::is_leaf() const
 {
-    return (m_left == nullptr) && (m_right == nullptr);
+    return m_left < 0;
 }
 
-std::shared_ptr<HuffmanTreeNode> HuffmanTreeNode::get_left() const
+int HuffmanTreeNode::get_left() const
 {
     return m_left;
 }
 
-std::shared_ptr<HuffmanTreeNode> HuffmanTreeNode::get_right() const
+int HuffmanTreeNode::get_right() const
 {
     return m_right;
 }
 
 /* Huffman Tree */
 
-// initialize with leaf node
-HuffmanTree::HuffmanTree(char ch, int weight)
-    : m_root { std::make_shared<HuffmanTreeNode>(ch, weight) }
-    , m_weight { weight }
+int HuffmanTree::add_leaf(char ch, uint64_t weight)
 {
+    m_nodes[m_size] = HuffmanTreeNode { ch, weight };
+    return m_size++;
 }
 
-// initialize with internal node 
-HuffmanTree::HuffmanTree(std::shared_ptr<HuffmanTreeNode> left, std::shared_ptr<HuffmanTreeNode> right)
-    : m_root { std::make_shared<HuffmanTreeNode>(left, right) }
+int HuffmanTree::add_internal_node(int left, int right)
 {
-    m_weight = m_root->get_weight();
+    m_nodes[m_size] = HuffmanTreeNode { left, right, m_nodes[left].get_weight() + m_nodes[right].get_weight() };
+    return m_size++;
 }
 
-std::shared_ptr<HuffmanTreeNode> HuffmanTree::get_root() const
+const HuffmanTreeNode& HuffmanTree::get_node(int index) const
 {
-    return m_root;
+    return m_nodes[index];
 }
 
-int HuffmanTree::get_weight() const 
+int HuffmanTree::get_root() const
 {
-    return m_root ? m_root->get_weight() : 0;
+    return m_size - 1;
 }
 
-bool HuffmanTree::operator< (const HuffmanTree& other)
+int HuffmanTree::size() const
 {
-    return get_weight() < other.get_weight();
+    return m_size;
 }
 
-bool HuffmanTree::operator> (const HuffmanTree& other)
+uint64_t HuffmanTree::get_weight() const 
 {
-    return get_weight() > other.get_weight();
+    return m_size > 0 ? m_nodes[m_size - 1].get_weight() : 0;
 }
 
-bool HuffmanTree::operator== (const HuffmanTree& other)
+HuffmanTree build_tree(const ByteHistogram& counted)
 {
-    return get_weight() == other.get_weight();
-}
-
-HuffmanTree build_tree(const std::unordered_map<char, int>& char_counts)
-{
-    // enqueue huffman trees
-    std::priority_queue<HuffmanTree, std::vector<HuffmanTree>, std::greater<>> min_heap {};
+    HuffmanTree tree {};
+    ByteHistogram scaled {};
+    const ByteHistogram& histogram { bound_histogram(counted, MAX_CODE_TOTAL, scaled) };
+
+    // two queue construction: with the leaves sorted by weight, the internal nodes 
+    // are created in order of increasing weight too. The two lightest trees are then 
+    // always at the front of either the leaf queue or the internal node queue, and 
+    // both queues are just ranges of the node array.
+    std::array<std::pair<uint64_t, uint8_t>, 256> leaves {};
+    int leaf_count { 0 };
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        if (histogram[symbol] > 0)
+        {
+            leaves[leaf_count++] = { histogram[symbol], static_cast<uint8_t>(symbol) };
+        }
+    }
+    std::sort(leaves.begin(), leaves.begin() + leaf_count);
 
-    for (const auto& [ch, weight] : char_counts)
+    for (int i = 0; i < leaf_count; ++i)
     {
-        HuffmanTree tree { ch, weight };
-        min_heap.push(std::move(tree));
+        tree.add_leaf(static_cast<char>(leaves[i].second), leaves[i].first);
     }
 
-    // combine huffman trees
-    while (min_heap.size() > 1)
+    int next_leaf { 0 };
+    int next_internal { leaf_count };
+    auto take_lightest { [&]() 
+    {
+        // ties go to the leaf, which keeps the tree shallower.
+        bool take_leaf { next_leaf < leaf_count 
+            && (next_internal == tree.size() || tree.get_node(next_leaf).get_weight() <= tree.get_node(next_internal).get_weight()) };
+        return take_leaf ? next_leaf++ : next_internal++;
+    } };
+
+    for (int i = 1; i < leaf_count; ++i)
     {
-        HuffmanTree first { min_heap.top() };
-        min_heap.pop();
-        HuffmanTree second { min_heap.top() };
-        min_heap.pop();
-        HuffmanTree combined { first.get_root(), second.get_root() };
-        min_heap.push(combined);
+        int first { take_lightest() };
+        int second { take_lightest() };
+        tree.add_internal_node(first, second);
     }
 
-    return min_heap.top();
+    return tree;
 }
 
 std::unordered_map<char, std::string> build_prefix_code_table(const HuffmanTree& tree)
 {
     std::unordered_map<char, std::string> table {};
     std::string prefix {};
-    if (auto root { tree.get_root() }; root != nullptr)
+    if (int root { tree.get_root() }; root >= 0)
     {
-        build_prefix_code_table_r(*root, table, prefix);
+        build_prefix_code_table_r(tree, root, table, prefix);
     }
 
     return table;
 }
 
-void build_prefix_code_table_r(const HuffmanTreeNode& node, std::unordered_map<char, std::string>& table, std::string& prefix)
+void build_prefix_code_table_r(const HuffmanTree& tree, int node, std::unordered_map<char, std::string>& table, std::string& prefix)
 {
-    if (node.is_leaf())
+    const HuffmanTreeNode& current { tree.get_node(node) };
+    if (current.is_leaf())
     {
-        table[node.get_char()] = prefix;
+        table[current.get_char()] = prefix;
     }
     else
     {
-        if (node.get_left() != nullptr)
-        {
-            prefix.push_back('0');
-            build_prefix_code_table_r(*node.get_left(), table, prefix);
-            prefix.pop_back();
-        }
-        if (node.get_right() != nullptr)
-        {
-            prefix.push_back('1');
-            build_prefix_code_table_r(*node.get_right(), table, prefix);
-            prefix.pop_back();
-        }
+        prefix.push_back('0');
+        build_prefix_code_table_r(tree, current.get_left(), table, prefix);
+        prefix.pop_back();
+
+        prefix.push_back('1');
+        build_prefix_code_table_r(tree, current.get_right(), table, prefix);
+        prefix.pop_back();
     }
 
     return;
@@ -152,40 +160,40 @@ void build_prefix_code_table_r(const HuffmanTreeNode& node, std::unordered_map<c
 
 char get_char_from_code(const std::string& prefix_code, const HuffmanTree& tree)
 {
-    std::shared_ptr<HuffmanTreeNode> current_node { tree.get_root() };
+    int current_node { tree.get_root() };
     for (auto& ch : prefix_code)
     {
         if (ch == '0')
         {
-            current_node = current_node->get_left();
+            current_node = tree.get_node(current_node).get_left();
         }
         else if (ch == '1')
         {
-            current_node = current_node->get_right();
+            current_node = tree.get_node(current_node).get_right();
         }
     }
 
-    return current_node->get_char();
+    return tree.get_node(current_node).get_char();
 }
 
 std::string get_string_from_codes(const std::string& prefix_codes, const HuffmanTree& tree)
 {
     std::string output {};
-    std::shared_ptr<HuffmanTreeNode> current_node { tree.get_root() };
+    int current_node { tree.get_root() };
     for (auto& ch : prefix_codes)
     {
         if (ch == '0')
         {
-            current_node = current_node->get_left();
+            current_node = tree.get_node(current_node).get_left();
         }
         else if (ch == '1')
         {
-            current_node = current_node->get_right();
+            current_node = tree.get_node(current_node).get_right();
         }
 
-        if (current_node->is_leaf())
+        if (tree.get_node(current_node).is_leaf())
         {
-            output += current_node->get_char();
+            output += tree.get_node(current_node).get_char();
             current_node = tree.get_root();
         }
     }
@@ -193,20 +201,466 @@ std::string get_string_from_codes(const std::string& prefix_codes, const Huffman
     return output;
 }
 
+CodeLengths build_code_lengths(const HuffmanTree& tree)
+{
+    // parents come after their children in the node array, so walking it from the 
+    // root backwards reaches every node after its parent.
+    CodeLengths lengths {};
+    std::array<uint8_t, MAX_TREE_NODES> depths {};
+    for (int node = tree.get_root(); node >= 0; --node)
+    {
+        const HuffmanTreeNode& current { tree.get_node(node) };
+        if (current.is_leaf())
+        {
+            // a tree with a single symbol still needs a one bit code, otherwise the 
+            // encoded body would be empty.
+            lengths[static_cast<uint8_t>(current.get_char())] = std::max<uint8_t>(depths[node], 1);
+            continue;
+        }
+        depths[current.get_left()] = depths[node] + 1;
+        depths[current.get_right()] = depths[node] + 1;
+    }
+
+    return lengths;
+}
 
-#ifdef TEST_HUFFMAN_TREE
-int main()
+// Package-merge: the optimal code with lengths of at most max_length picks the 
+// 2n - 2 cheapest items from a list built by repeatedly pairing up ("packaging") 
+// the previous list and merging the packages back in with the leaves. A symbol's 
+// code length is the number of lists in which its leaf gets picked.
+CodeLengths package_merge(const std::vector<std::pair<uint64_t, uint8_t>>& leaves, int max_length)
 {
-    std::unordered_map<char, int> char_counts 
+    struct Item
     {
-        { 'a', 5 },
-        { 'b', 9 },
-        { 'c', 3 },
-        { 'z', 50 },
-        { 'e', 6 }
+        uint64_t weight {};
+        bool is_package {};
+        uint8_t symbol {};
     };
 
-    HuffmanTree tree { build_tree(char_counts) };
+    // lists[0] is the deepest level, holding only leaves. The lists are kept per 
+    // thread, so codes built over and over reuse their memory.
+    thread_local std::vector<std::vector<Item>> lists {};
+    lists.resize(std::max<size_t>(lists.size(), max_length));
+    for (int level = 0; level < max_length; ++level)
+    {
+        lists[level].clear();
+    }
+    for (const auto& [weight, symbol] : leaves)
+    {
+        lists[0].push_back({ weight, false, symbol });
+    }
+
+    for (int level = 1; level < max_length; ++level)
+    {
+        const std::vector<Item>& previous { lists[level - 1] };
+        std::vector<Item>& current { lists[level] };
+        size_t leaf { 0 };
+        size_t package { 0 };
+        size_t package_count { previous.size() / 2 };
+        while (leaf < leaves.size() || package < package_count)
+        {
+            uint64_t package_weight { package < package_count ? previous[2 * package].weight + previous[2 * package + 1].weight : 0 };
+            if (package == package_count || (leaf < leaves.size() && leaves[leaf].first <= package_weight))
+            {
+                current.push_back({ leaves[leaf].first, false, leaves[leaf].second });
+                ++leaf;
+            }
+            else
+            {
+                current.push_back({ package_weight, true, 0 });
+                ++package;
+            }
+        }
+    }
+
+    // walk back down: the packages picked in one list are made of the first 
+    // 2 * packages items of the list below it.
+    CodeLengths lengths {};
+    size_t picked { 2 * leaves.size() - 2 };
+    for (int level = max_length - 1; level >= 0 && picked > 0; --level)
+    {
+        size_t packages { 0 };
+        for (size_t i = 0; i < picked; ++i)
+        {
+            const Item& item { lists[level][i] };
+            if (item.is_package)
+            {
+                ++packages;
+            }
+            else
+            {
+                ++lengths[item.symbol];
+            }
+        }
+        picked = 2 * packages;
+    }
+
+    return lengths;
+}
+
+bool build_limited_code_lengths(const ByteHistogram& histogram, int max_length, CodeLengths& lengths)
+{
+    if (max_length < 1 || max_length > MAX_CODE_LENGTH || count_symbols(histogram) > (1ll << max_length))
+    {
+        return false;
+    }
+
+    // the unrestricted tree is optimal and cheaper to build, so only fall back to 
+    // package-merge when it is too deep.
+    lengths = build_code_lengths(build_tree(histogram));
+    if (*std::max_element(lengths.begin(), lengths.end()) <= max_length)
+    {
+        return true;
+    }
+
+    // the packages of a list weigh at most its level times the total, which the 
+    // bound keeps well within 64 bits.
+    ByteHistogram scaled {};
+    const ByteHistogram& weights { bound_histogram(histogram, MAX_CODE_TOTAL, scaled) };
+    thread_local std::vector<std::pair<uint64_t, uint8_t>> leaves {};
+    leaves.clear();
+    for (size_t symbol = 0; symbol < weights.size(); ++symbol)
+    {
+        if (weights[symbol] > 0)
+        {
+            leaves.push_back({ weights[symbol], static_cast<uint8_t>(symbol) });
+        }
+    }
+    std::sort(leaves.begin(), leaves.end());
+
+    lengths = package_merge(leaves, max_length);
+
+    return true;
+}
+
+uint64_t get_encoded_bit_count(const ByteHistogram& histogram, const CodeLengths& lengths)
+{
+    uint64_t bit_count { 0 };
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        bit_count += histogram[symbol] * lengths[symbol];
+    }
+
+    return bit_count;
+}
+
+void write_code_lengths(std::vector<uint8_t>& out, const CodeLengths& lengths)
+{
+    // the code length of every byte value in order is all the decoder needs to 
+    // rebuild the canonical codes. Most byte values never occur, so a 0 length is 
+    // followed by the number of further zero lengths in the run.
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol)
+    {
+        out.push_back(lengths[symbol]);
+        if (lengths[symbol] != 0)
+        {
+            continue;
+        }
+
+        uint8_t run { 0 };
+        while (symbol + 1 < lengths.size() && lengths[symbol + 1] == 0)
+        {
+            ++run;
+            ++symbol;
+        }
+        out.push_back(run);
+    }
+}
+
+bool read_code_lengths(const uint8_t* data, size_t size, CodeLengths& lengths, size_t& header_size)
+{
+    // the code length of every byte value in order, with runs of zero lengths 
+    // collapsed into a 0 followed by the number of further zeros.
+    size_t pos { 0 };
+    size_t symbol { 0 };
+    while (symbol < lengths.size())
+    {
+        if (pos >= size)
+        {
+            return false;
+        }
+        uint8_t length { data[pos++] };
+        lengths[symbol++] = length;
+        if (length != 0)
+        {
+            continue;
+        }
+
+        if (pos >= size || symbol + data[pos] > lengths.size())
+        {
+            return false;
+        }
+        for (uint8_t i = 0; i < data[pos]; ++i)
+        {
+            lengths[symbol++] = 0;
+        }
+        ++pos;
+    }
+    header_size = pos;
+
+    return true;
+}
+
+bool build_canonical_codes(const CodeLengths& lengths, HuffmanCodeTable& codes)
+{
+    std::array<uint32_t, MAX_CODE_LENGTH + 1> length_counts {};
+    for (uint8_t length : lengths)
+    {
+        if (length > MAX_CODE_LENGTH)
+        {
+            return false;
+        }
+        ++length_counts[length];
+    }
+    length_counts[0] = 0;
+
+    // the first code of each length follows on from the last code of the previous 
+    // length, extended by one bit. Running past 2^length means the lengths do not 
+    // describe a prefix code.
+    std::array<uint64_t, MAX_CODE_LENGTH + 1> next_code {};
+    uint64_t code { 0 };
+    for (int length = 1; length <= MAX_CODE_LENGTH; ++length)
+    {
+        code = (code + length_counts[length - 1]) << 1;
+        next_code[length] = code;
+        if (code + length_counts[length] > (uint64_t { 1 } << length))
+        {
+            return false;
+        }
+    }
+
+    for (size_t symbol = 0; symbol < lengths.size(); ++symbol)
+    {
+        uint8_t length { lengths[symbol] };
+        codes[symbol] = length ? HuffmanCode { static_cast<uint32_t>(next_code[length]++), length } : HuffmanCode {};
+    }
+
+    return true;
+}
+
+bool HuffmanDecodeTable::build(const HuffmanCodeTable& codes)
+{
+    std::fill(m_primary.begin(), m_primary.end(), HuffmanDecodeEntry {});
+    m_secondary.clear();
+
+    // codes longer than the primary table are grouped by their first PRIMARY_BITS 
+    // bits. Each group gets a secondary table wide enough for its longest code.
+    std::array<int, 1 << PRIMARY_BITS> sub_bits {};
+    for (const HuffmanCode& code : codes)
+    {
+        if (code.length > MAX_CODE_LENGTH)
+        {
+            return false;
+        }
+        if (code.length > PRIMARY_BITS)
+        {
+            int extra { code.length - PRIMARY_BITS };
+            uint32_t prefix { code.bits >> extra };
+            sub_bits[prefix] = std::max(sub_bits[prefix], extra);
+        }
+    }
+
+    for (uint32_t prefix = 0; prefix < sub_bits.size(); ++prefix)
+    {
+        if (sub_bits[prefix] == 0)
+        {
+            continue;
+        }
+        HuffmanDecodeEntry& link { m_primary[prefix] };
+        link.value = m_secondary.size();
+        link.sub_bits = sub_bits[prefix];
+        m_secondary.resize(m_secondary.size() + (size_t { 1 } << sub_bits[prefix]));
+    }
+
+    for (size_t symbol = 0; symbol < codes.size(); ++symbol)
+    {
+        const HuffmanCode& code { codes[symbol] };
+        if (code.length == 0)
+        {
+            continue;
+        }
+
+        // a code fills every entry whose index starts with it. Overlaps mean the 
+        // codes are not prefix free.
+        HuffmanDecodeEntry* entries {};
+        uint32_t first {};
+        uint32_t count {};
+        uint8_t length {};
+        if (code.length <= PRIMARY_BITS)
+        {
+            entries = m_primary.data();
+            first = code.bits << (PRIMARY_BITS - code.length);
+            count = 1u << (PRIMARY_BITS - code.length);
+            length = code.length;
+        }
+        else
+        {
+            int extra { code.length - PRIMARY_BITS };
+            const HuffmanDecodeEntry& link { m_primary[code.bits >> extra] };
+            uint32_t suffix { code.bits & ((1u << extra) - 1) };
+            entries = m_secondary.data() + link.value;
+            first = suffix << (link.sub_bits - extra);
+            count = 1u << (link.sub_bits - extra);
+            length = extra;
+        }
+
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            if (entries[i].length != 0 || entries[i].sub_bits != 0)
+            {
+                return false;
+            }
+            entries[i].value = symbol;
+            entries[i].length = length;
+        }
+    }
+
+    return true;
+}
+
+
+AdaptiveHuffmanCoder::AdaptiveHuffmanCoder()
+{
+    m_leaves.fill(-1);
+}
+
+void AdaptiveHuffmanCoder::swap_nodes(int a, int b)
+{
+    // swapping two positions swaps the subtrees hanging there. The parents keep 
+    // pointing at the same positions, only the moved nodes' links need fixing.
+    std::swap(m_nodes[a], m_nodes[b]);
+    std::swap(m_nodes[a].parent, m_nodes[b].parent);
+    for (int node : { a, b })
+    {
+        const Node& moved { m_nodes[node] };
+        if (moved.left != -1)
+        {
+            m_nodes[moved.left].parent = node;
+            m_nodes[moved.right].parent = node;
+        }
+        else if (moved.symbol != -1)
+        {
+            m_leaves[moved.symbol] = node;
+        }
+        else
+        {
+            m_nyt = node;
+        }
+    }
+}
+
+void AdaptiveHuffmanCoder::update(uint8_t symbol)
+{
+    int node { m_leaves[symbol] };
+    if (node == -1)
+    {
+        // the NYT node splits into a new NYT node and a leaf for the symbol. New 
+        // nodes have the lowest order, so they go at the end of the array.
+        int parent { m_nyt };
+        node = m_size;
+        m_nyt = m_size + 1;
+        m_size += 2;
+        m_nodes[parent].left = m_nyt;
+        m_nodes[parent].right = node;
+        m_nodes[node] = Node { 0, static_cast<int16_t>(parent), -1, -1, symbol };
+        m_nodes[m_nyt] = Node { 0, static_cast<int16_t>(parent), -1, -1, -1 };
+        m_leaves[symbol] = node;
+    }
+
+    // before each increment the node moves to the front of its block of equal 
+    // weights, which keeps the weights ordered after the increment.
+    while (node != -1)
+    {
+        int leader { node };
+        while (leader > 0 && m_nodes[leader - 1].weight == m_nodes[node].weight)
+        {
+            --leader;
+        }
+        if (leader != node && leader != m_nodes[node].parent)
+        {
+            swap_nodes(leader, node);
+            node = leader;
+        }
+        ++m_nodes[node].weight;
+        node = m_nodes[node].parent;
+    }
+}
+
+void AdaptiveHuffmanCoder::encode(uint8_t symbol, BitWriter& writer)
+{
+    int node { m_leaves[symbol] != -1 ? m_leaves[symbol] : m_nyt };
+
+    // the code is the path from the root, collected leaf first. Paths can be far 
+    // longer than 32 bits, so they are written in pieces.
+    int length { 0 };
+    for (; m_nodes[node].parent != -1; node = m_nodes[node].parent)
+    {
+        m_path[length++] = m_nodes[m_nodes[node].parent].right == node;
+    }
+    while (length > 0)
+    {
+        int take { std::min(length, 32) };
+        uint32_t bits { 0 };
+        for (int i = 0; i < take; ++i)
+        {
+            bits = (bits << 1) | m_path[--length];
+        }
+        writer.write(bits, take);
+    }
+
+    if (m_leaves[symbol] == -1)
+    {
+        writer.write(symbol, 8);
+    }
+
+    update(symbol);
+}
+
+uint8_t AdaptiveHuffmanCoder::decode(BitReader& reader)
+{
+    // walks down from the root one bit at a time. The reader holds at least 56 
+    // bits after a refill, so it only needs topping up on very deep paths.
+    reader.refill();
+    int node { 0 };
+    int depth { 0 };
+    while (m_nodes[node].left != -1)
+    {
+        if (++depth == 48)
+        {
+            reader.refill();
+            depth = 0;
+        }
+        node = reader.peek(1) ? m_nodes[node].right : m_nodes[node].left;
+        reader.consume(1);
+    }
+
+    uint8_t symbol {};
+    if (node == m_nyt)
+    {
+        reader.refill();
+        symbol = reader.peek(8);
+        reader.consume(8);
+    }
+    else
+    {
+        symbol = m_nodes[node].symbol;
+    }
+
+    update(symbol);
+    return symbol;
+}
+
+#ifdef TEST_HUFFMAN_TREE
+int main()
+{
+    ByteHistogram histogram {};
+    histogram['a'] = 5;
+    histogram['b'] = 9;
+    histogram['c'] = 3;
+    histogram['z'] = 50;
+    histogram['e'] = 6;
+
+    HuffmanTree tree { build_tree(histogram) };
     std::unordered_map<char, std::string> table { build_prefix_code_table(tree) };
 
     for (const auto& kv : table) 
@@ -1,50 +1,152 @@
 #pragma once
 
-#include <memory>
-#include <map>
-#include <queue>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bitstream.h"
+#include "histogram.h"
+
+// Trees live in a flat array: leaves and internal nodes refer to each other by 
+// index, so building or walking a tree never touches the heap. 256 byte values 
+// need at most 256 leaves and 255 internal nodes.
+constexpr int MAX_TREE_NODES { 2 * 256 - 1 };
 
 class HuffmanTreeNode 
 {
 private:
-    int m_weight {};
-    std::shared_ptr<HuffmanTreeNode> m_left {};
-    std::shared_ptr<HuffmanTreeNode> m_right {};
+    uint64_t m_weight {};
+    int16_t m_left { -1 };
+    int16_t m_right { -1 };
     char m_char {};
 
 public:
     HuffmanTreeNode(){};
-    HuffmanTreeNode(char char_, int weight); // leaf node 
-    HuffmanTreeNode(std::shared_ptr<HuffmanTreeNode> left, std::shared_ptr<HuffmanTreeNode> right); // internal node
+    HuffmanTreeNode(char char_, uint64_t weight); // leaf node 
+    HuffmanTreeNode(int left, int right, uint64_t weight); // internal node
 
-    int get_weight() const;
+    uint64_t get_weight() const;
     char get_char() const;
-    std::shared_ptr<HuffmanTreeNode> get_left() const;
-    std::shared_ptr<HuffmanTreeNode> get_right() const;
+    int get_left() const;
+    int get_right() const;
     bool is_leaf() const;
 };
 
 class HuffmanTree
 {
 private:
-    std::shared_ptr<HuffmanTreeNode> m_root {};
-    int m_weight {};
+    std::array<HuffmanTreeNode, MAX_TREE_NODES> m_nodes {};
+    int m_size {};
 
 public:
-    HuffmanTree(){};
-    HuffmanTree(char char_, int weight);
-    HuffmanTree(std::shared_ptr<HuffmanTreeNode> left, std::shared_ptr<HuffmanTreeNode> right);
-
-    std::shared_ptr<HuffmanTreeNode> get_root() const;
-    int get_weight() const;
+    // nodes are appended, so children always come before their parent and the 
+    // last node is the root.
+    int add_leaf(char char_, uint64_t weight);
+    int add_internal_node(int left, int right);
 
-    bool operator< (const HuffmanTree& other);
-    bool operator> (const HuffmanTree& other);
-    bool operator== (const HuffmanTree& other);
+    const HuffmanTreeNode& get_node(int index) const;
+    int get_root() const; // -1 for an empty tree
+    int size() const;
+    uint64_t get_weight() const;
 };
 
-HuffmanTree build_tree(const std::unordered_map<char, int>& char_counts);
+HuffmanTree build_tree(const ByteHistogram& histogram);
 std::unordered_map<char, std::string> build_prefix_code_table(const HuffmanTree& tree);
-void build_prefix_code_table_r(const HuffmanTreeNode& node, std::unordered_map<char, std::string>& table, std::string& prefix);
+void build_prefix_code_table_r(const HuffmanTree& tree, int node, std::unordered_map<char, std::string>& table, std::string& prefix);
 char get_char_from_code(const std::string& prefix_code, const HuffmanTree& tree);
-std::string get_string_from_codes(const std::string& prefix_codes, const HuffmanTree& tree);
\ No newline at end of file
+std::string get_string_from_codes(const std::string& prefix_codes, const HuffmanTree& tree);
+
+constexpr int MAX_CODE_LENGTH { 32 };
+
+// codes up to this length decode with a single lookup, see HuffmanDecodeTable.
+constexpr int DEFAULT_MAX_CODE_LENGTH { 11 };
+
+// a prefix code packed into an integer, read most significant bit first.
+struct HuffmanCode
+{
+    uint32_t bits {};
+    uint8_t length {};
+};
+
+// code length per byte value, 0 for bytes that do not occur.
+using CodeLengths = std::array<uint8_t, 256>;
+using HuffmanCodeTable = std::array<HuffmanCode, 256>;
+
+// Canonical Huffman codes are fully determined by their lengths: codes are assigned 
+// in increasing order of (length, symbol). Only the lengths need to be stored.
+CodeLengths build_code_lengths(const HuffmanTree& tree);
+bool build_limited_code_lengths(const ByteHistogram& histogram, int max_length, CodeLengths& lengths);
+uint64_t get_encoded_bit_count(const ByteHistogram& histogram, const CodeLengths& lengths);
+bool build_canonical_codes(const CodeLengths& lengths, HuffmanCodeTable& codes);
+
+// serialized code lengths, as stored in block and dictionary headers. header_size
+// is set to the number of bytes read.
+void write_code_lengths(std::vector<uint8_t>& out, const CodeLengths& lengths);
+bool read_code_lengths(const uint8_t* data, size_t size, CodeLengths& lengths, size_t& header_size);
+
+// Lookup table decoder. The next PRIMARY_BITS bits of the stream index the primary 
+// table, which resolves every code of up to PRIMARY_BITS bits in a single hit. Longer 
+// codes share a primary entry with their prefix, which links to a secondary table 
+// indexed by the bits that follow.
+struct HuffmanDecodeEntry
+{
+    uint32_t value {};  // decoded symbol, or the secondary table offset for links
+    uint8_t length {};  // bits to consume, 0 for links and unused entries
+    uint8_t sub_bits {}; // index width of the linked secondary table
+};
+
+class HuffmanDecodeTable
+{
+public:
+    static constexpr int PRIMARY_BITS { DEFAULT_MAX_CODE_LENGTH };
+
+private:
+    std::vector<HuffmanDecodeEntry> m_primary { std::vector<HuffmanDecodeEntry>(1 << PRIMARY_BITS) };
+    std::vector<HuffmanDecodeEntry> m_secondary {};
+
+public:
+    bool build(const HuffmanCodeTable& codes);
+
+    const HuffmanDecodeEntry* primary() const { return m_primary.data(); }
+    const HuffmanDecodeEntry* secondary() const { return m_secondary.data(); }
+};
+// Adaptive (FGK) Huffman coding. Encoder and decoder start from the same tree 
+// holding only the not-yet-transmitted (NYT) node and update it after every 
+// symbol, so no code lengths are ever stored. A byte seen for the first time is 
+// sent as the code of the NYT node followed by its 8 raw bits.
+//
+// Nodes are kept in the array in decreasing FGK order, the root first. Weights 
+// never increase along the array (the sibling property), so the leader of a 
+// block of equal weights is the first node of the block.
+class AdaptiveHuffmanCoder
+{
+public:
+    static constexpr int MAX_NODES { 2 * 257 - 1 }; // 256 leaves, NYT and their parents
+
+private:
+    struct Node
+    {
+        uint32_t weight {};
+        int16_t parent { -1 };
+        int16_t left { -1 };  // -1 for leaves and NYT
+        int16_t right { -1 };
+        int16_t symbol { -1 }; // -1 for internal nodes and NYT
+    };
+
+    std::array<Node, MAX_NODES> m_nodes {};
+    std::array<int16_t, 256> m_leaves {}; // node of each byte, -1 until it is seen
+    int m_nyt { 0 };
+    int m_size { 1 };
+    std::array<uint8_t, MAX_NODES> m_path {}; // encode's scratch, only read up to the path length
+
+    void swap_nodes(int a, int b);
+    void update(uint8_t symbol);
+
+public:
+    AdaptiveHuffmanCoder();
+
+    void encode(uint8_t symbol, BitWriter& writer);
+    uint8_t decode(BitReader& reader);
+};
@@ -1,36 +1,368 @@
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstdlib>
 #include <filesystem>
+#include <getopt.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
+#include "batch.h"
 #include "compress.h"
 #include "decompress.h"
+#include "dictionary.h"
+#include "input_source.h"
 
 const char* PROGRAM_NAME;
 
+struct Options
+{
+    bool compress {};
+    bool force_decompress {};
+    bool to_stdout {};
+    // a file decompressed to is created by decompress_file, which writes its 
+    // blocks straight into place.
+    std::string decompress_path {};
+    CompressOptions compress_options {};
+    DecompressOptions decompress_options {};
+
+    // --range OFFSET:LEN writes part of the decompressed data to standard output.
+    bool extract_range {};
+    uint64_t range_offset {};
+    uint64_t range_length {};
+
+    // --train DICT builds a dictionary from the sample files and writes it to DICT.
+    std::string train_path {};
+    std::vector<std::string> sample_paths {};
+    std::string dictionary_path {};
+
+    // several paths, or --files-from LIST, process every file on one thread pool.
+    std::string files_from {};
+    bool batch {};
+    bool batch_incomplete {}; // some paths were rejected before the batch started
+    std::vector<BatchFile> batch_files {};
+
+    // --stats reports where the time went on standard error, --stats=json as JSON.
+    bool stats {};
+    bool stats_json {};
+};
+
 void print_usage(std::ostream& stream)
 {
     stream << "jzip compresses files or expands them depending on the file type passed.\n"
            << "If the file type is a text file or comparable file, it will generate a <filename>.jzip file with compressed contents.\n"
-           << "If the file type is a file ending in .jzip, it will decompress the file.\n\n"
-           << "Usage: " << PROGRAM_NAME << " <-oh> " <<"<filepath>\n"
-           << "\t-h display this usage information.\n";
+           << "If the file type is a file ending in .jzip, it will decompress the file.\n"
+           << "Without a file path, standard input is compressed (or expanded with -d) to standard output.\n\n"
+           << "Usage: " << PROGRAM_NAME << " <-0..9> <-acdhv> <-b KiB> <-j threads> <-l bits> <-w bits> <--coder name> <--order1> <--single-stream> <--range offset:length> <--dict path> <--stats[=json]> " <<"<filepaths>\n"
+           << "       " << PROGRAM_NAME << " <-l bits> --train <dictionary path> <sample filepaths>\n"
+           << "\t-h display this usage information.\n"
+           << "\t-1 .. -9 find repeated strings first (LZ77), from -1 fastest to -9 smallest output.\n"
+           << "\t   -0 codes single bytes only (default).\n"
+           << "\t-a use adaptive Huffman codes, which need no counting pass or code tables.\n"
+           << "\t-c write to standard output instead of a file.\n"
+           << "\t-d decompress, regardless of the file name.\n"
+           << "\t-b compress in independent blocks of the given size in KiB (default " << DEFAULT_BLOCK_SIZE / 1024 << ").\n"
+           << "\t-j number of threads used for compression and decompression (default: one per core).\n"
+           << "\t-w LZ77 window size as a power of two, from " << MIN_WINDOW_BITS << " to " << MAX_WINDOW_BITS 
+           << " (default " << DEFAULT_WINDOW_BITS << ").\n"
+           << "\t-l limit prefix codes to the given number of bits (default " << DEFAULT_MAX_CODE_LENGTH << ").\n"
+           << "\t   Codes of up to " << DEFAULT_MAX_CODE_LENGTH << " bits decode with a single table lookup.\n"
+           << "\t-v report details about the compression.\n"
+           << "\t--coder entropy coder for each block: huffman (default), tans, or auto to take the smaller.\n"
+           << "\t--order1 also try Huffman tables picked by the previous byte, for blocks where that is smaller.\n"
+           << "\t--single-stream write each block as one Huffman bitstream instead of " << STREAM_COUNT << " interleaved ones.\n"
+           << "\t--range write length bytes of a .jzip file's contents from offset to standard output,\n"
+           << "\t   only decoding the blocks they fall in. Sizes take an optional K, M or G suffix.\n"
+           << "\t--train build a dictionary of code tables from the sample files (or standard input) and\n"
+           << "\t   write it to the given path. Small files compressed with it carry no tables of their own.\n"
+           << "\t--files-from also process the files listed in the given file, one path per line (- for standard input).\n"
+           << "\t   Several files are processed at once, spread over the threads given by -j.\n"
+           << "\t--dict compress with the dictionary's tables wherever they are smaller, or decompress a file\n"
+           << "\t   compressed with it. Decompressing needs the same dictionary.\n"
+           << "\t--stats report sizes, block methods and the time spent in each phase on standard error.\n"
+           << "\t   --stats=json writes the report as JSON.\n";
+}
+
+// parses a byte count with an optional binary K, M or G suffix.
+bool parse_size(const std::string& text, uint64_t& size)
+{
+    char* end {};
+    size = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || text[0] == '-')
+    {
+        return false;
+    }
+
+    switch (*end)
+    {
+    case 'G':
+        size <<= 10;
+        [[fallthrough]];
+    case 'M':
+        size <<= 10;
+        [[fallthrough]];
+    case 'K':
+        size <<= 10;
+        ++end;
+        break;
+    default:
+        break;
+    }
+
+    return *end == '\0';
+}
+
+bool parse_range(const std::string& text, uint64_t& offset, uint64_t& length)
+{
+    size_t colon { text.find(':') };
+    if (colon == std::string::npos)
+    {
+        return false;
+    }
+
+    return parse_size(text.substr(0, colon), offset) && parse_size(text.substr(colon + 1), length);
+}
+
+// checks that path names a regular file.
+bool check_input_path(const std::string& path)
+{
+    std::filesystem::path file_system_path { path };
+    if (!std::filesystem::exists(file_system_path))
+    {
+        std::cerr << "Error: file " << path << " does not exist.\n";
+        return false;
+    }
+    if (!std::filesystem::is_regular_file(file_system_path))
+    {
+        std::cerr << "Error: file " << path << " is not a regular file.\n";
+        return false;
+    }
+
+    return true;
+}
+
+// based on the file type of the input file, we decide the name of the output
+// file and whether the operation we perform on it will be compression or decompression.
+std::string name_output(const std::string& infilepath, const Options& opts, bool& compress)
+{
+    if (std::filesystem::path { infilepath }.extension().string() == ".jzip")
+    {
+        compress = false;
+        return infilepath.substr(0, infilepath.size() - 5);
+    }
+    compress = !opts.force_decompress;
+    return infilepath + ".jzip";
+}
+
+// checks that the output of a file can be written, like for a single file.
+bool check_output_path(const std::string& infilepath, const std::string& outfilepath, const Options& opts)
+{
+    if (opts.force_decompress && outfilepath == infilepath + ".jzip")
+    {
+        std::cerr << "Error: file " << infilepath << " does not end in .jzip, use -c to decompress it to standard output.\n";
+        return false;
+    }
+
+    // ensure output file does not already exist.
+    if (std::filesystem::exists(std::filesystem::path { outfilepath }))
+    {
+        std::cerr << "Error: the file " << outfilepath << " already exists. Delete or rename this file before proceeding\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool read_file_list(const std::string& list_path, std::vector<std::string>& paths)
+{
+    std::ifstream list_file {};
+    if (list_path != "-")
+    {
+        list_file.open(list_path);
+        if (!list_file)
+        {
+            std::cerr << "Error: file list " << list_path << " could not be opened.\n";
+            return false;
+        }
+    }
+
+    std::istream& list { list_path == "-" ? std::cin : list_file };
+    std::string path {};
+    while (std::getline(list, path))
+    {
+        if (!path.empty())
+        {
+            paths.push_back(path);
+        }
+    }
+    if (list.bad())
+    {
+        std::cerr << "Error: file list " << list_path << " could not be read.\n";
+        return false;
+    }
+
+    return true;
 }
 
-bool process_arguments(std::ifstream& infile, std::ofstream& outfile, bool& compress, int argc, char* argv[])
+bool plan_batch(Options& opts, const std::vector<std::string>& paths)
+{
+    if (opts.to_stdout || opts.extract_range || opts.stats)
+    {
+        std::cerr << "Error: -c, --range and --stats take a single file.\n";
+        return false;
+    }
+
+    // a file that can't be processed is reported and skipped, the rest still are.
+    opts.batch = true;
+    for (const std::string& path : paths)
+    {
+        BatchFile file { path };
+        file.output_path = name_output(path, opts, file.compress);
+        if (check_input_path(path) && check_output_path(path, file.output_path, opts))
+        {
+            opts.batch_files.push_back(file);
+        }
+        else
+        {
+            opts.batch_incomplete = true;
+        }
+    }
+
+    return true;
+}
+
+bool process_arguments(InputSource& input, std::ofstream& outfile, Options& opts, int argc, char* argv[])
 {
     PROGRAM_NAME = argv[0];
     int opt {};
-    const char* opt_flags { "h" };
-    
-    while ((opt = getopt(argc, argv, opt_flags)) != -1)
+    const char* opt_flags { "0123456789ab:cdhj:l:vw:" };
+    const option long_opts[] {
+        { "range", required_argument, nullptr, 'r' },
+        { "single-stream", no_argument, nullptr, 's' },
+        { "coder", required_argument, nullptr, 'e' },
+        { "order1", no_argument, nullptr, 'o' },
+        { "train", required_argument, nullptr, 't' },
+        { "dict", required_argument, nullptr, 'D' },
+        { "files-from", required_argument, nullptr, 'F' },
+        { "stats", optional_argument, nullptr, 'S' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    char* end {};
+    long value {};
+
+    while ((opt = getopt_long(argc, argv, opt_flags, long_opts, nullptr)) != -1)
     {
         switch (opt)
         {
         case 'h':
             print_usage(std::cout);
             std::exit(0);
+        case '0': case '1': case '2': case '3': case '4': 
+        case '5': case '6': case '7': case '8': case '9':
+            opts.compress_options.level = opt - '0';
+            break;
+        case 'a':
+            opts.compress_options.adaptive = true;
+            break;
+        case 'b':
+            value = std::strtol(optarg, &end, 10);
+            if (*end != '\0' || value < 1 || static_cast<size_t>(value) > MAX_BLOCK_SIZE / 1024)
+            {
+                std::cerr << "Error: block size must be between 1 and " << MAX_BLOCK_SIZE / 1024 << " KiB.\n";
+                return false;
+            }
+            opts.compress_options.block_size = value * 1024;
+            break;
+        case 'c':
+            opts.to_stdout = true;
+            break;
+        case 'd':
+            opts.force_decompress = true;
+            break;
+        case 'j':
+            value = std::strtol(optarg, &end, 10);
+            if (*end != '\0' || value < 1)
+            {
+                std::cerr << "Error: thread count must be at least 1.\n";
+                return false;
+            }
+            opts.compress_options.threads = value;
+            opts.decompress_options.threads = value;
+            break;
+        case 'l':
+            value = std::strtol(optarg, &end, 10);
+            if (*end != '\0' || value < 1 || value > MAX_CODE_LENGTH)
+            {
+                std::cerr << "Error: code length limit must be between 1 and " << MAX_CODE_LENGTH << ".\n";
+                return false;
+            }
+            opts.compress_options.max_code_length = value;
+            break;
+        case 'w':
+            value = std::strtol(optarg, &end, 10);
+            if (*end != '\0' || value < MIN_WINDOW_BITS || value > MAX_WINDOW_BITS)
+            {
+                std::cerr << "Error: window size must be between " << MIN_WINDOW_BITS << " and " << MAX_WINDOW_BITS << " bits.\n";
+                return false;
+            }
+            opts.compress_options.window_bits = value;
+            break;
+        case 'v':
+            opts.compress_options.verbose = true;
+            break;
+        case 'e':
+            if (std::string { optarg } == "huffman")
+            {
+                opts.compress_options.coder = EntropyCoder::huffman;
+            }
+            else if (std::string { optarg } == "tans")
+            {
+                opts.compress_options.coder = EntropyCoder::tans;
+            }
+            else if (std::string { optarg } == "auto")
+            {
+                opts.compress_options.coder = EntropyCoder::automatic;
+            }
+            else
+            {
+                std::cerr << "Error: coder must be huffman, tans or auto.\n";
+                return false;
+            }
+            break;
+        case 'o':
+            opts.compress_options.context_model = true;
+            break;
+        case 's':
+            opts.compress_options.interleave = false;
+            break;
+        case 'r':
+            if (!parse_range(optarg, opts.range_offset, opts.range_length))
+            {
+                std::cerr << "Error: range must be given as offset:length, e.g. 5G:100M.\n";
+                return false;
+            }
+            opts.extract_range = true;
+            break;
+        case 't':
+            opts.train_path = optarg;
+            break;
+        case 'D':
+            opts.dictionary_path = optarg;
+            break;
+        case 'F':
+            opts.files_from = optarg;
+            break;
+        case 'S':
+            if (optarg && std::string { optarg } != "json")
+            {
+                std::cerr << "Error: --stats takes no format or json.\n";
+                return false;
+            }
+            opts.stats = true;
+            opts.stats_json = optarg != nullptr;
+            break;
         case '?':
             print_usage(std::cerr);
             return false;
@@ -39,88 +371,252 @@ bool process_arguments(std::ifstream& infile, std::ofstream& outfile, bool& comp
         }
     }
 
-    // when a infilepath is given we want to error check and unload to istream
-    if (optind < argc)
+    // training takes any number of samples and writes only the dictionary.
+    if (!opts.train_path.empty())
     {
-        std::string infilepath { argv[optind] };
-        std::filesystem::path infile_system_path { infilepath };
-
-        // check if file is valid. 
-        if (!std::filesystem::exists(infile_system_path))
+        if (opts.extract_range || !opts.dictionary_path.empty())
         {
-            std::cerr << "Error: file " << infilepath << " does not exist.\n";
+            std::cerr << "Error: --train can't be combined with --range or --dict.\n";
             return false;
         }
-        if (!std::filesystem::is_regular_file(infile_system_path))
+        if (opts.compress_options.max_code_length < 8)
         {
-            std::cerr << "Error: file " << infilepath << " is not a regular file.\n";
+            std::cerr << "Error: a dictionary has a code for every byte value, which needs -l 8 or more.\n";
             return false;
         }
+        if (std::filesystem::exists(opts.train_path))
+        {
+            std::cerr << "Error: the file " << opts.train_path << " already exists. Delete or rename this file before proceeding\n";
+            return false;
+        }
+        opts.sample_paths.assign(argv + optind, argv + argc);
+        return true;
+    }
+
+    // many files are handed to the batch, which opens them as it gets to them.
+    std::vector<std::string> paths(argv + optind, argv + argc);
+    if (!opts.files_from.empty() && !read_file_list(opts.files_from, paths))
+    {
+        return false;
+    }
+    if (paths.size() > 1 || !opts.files_from.empty())
+    {
+        return plan_batch(opts, paths);
+    }
 
-        infile.open(infilepath, std::ios::in | std::ios::binary);
+    // when a infilepath is given we want to error check and open it
+    if (!paths.empty())
+    {
+        std::string infilepath { paths[0] };
+        if (!check_input_path(infilepath))
+        {
+            return false;
+        }
 
-        if (!infile.is_open() || infile.bad())
+        if (!input.open(infilepath))
         {
             std::cerr << "Error: file " << infilepath << " could not be opened.\n";
             return false;
         }
 
-        // based on the file type of the input file, we decide the name of the output 
-        // file and whether the operation we perform on it will be compression or decompression. 
-        std::string outfilepath {};
-        if (infile_system_path.extension().string() == ".jzip")
+        std::string outfilepath { name_output(infilepath, opts, opts.compress) };
+
+        // a range is written to standard output, there is no output file.
+        if (opts.extract_range)
         {
-            outfilepath = infilepath.substr(0, infilepath.size() - 5);
-            compress = false;
+            if (opts.compress)
+            {
+                std::cerr << "Error: --range needs a .jzip file.\n";
+                return false;
+            }
+            opts.to_stdout = true;
+            return true;
         }
-        else 
+
+        if (opts.to_stdout)
         {
-            outfilepath = infilepath + ".jzip";
-            compress = true;
+            return true;
         }
 
-        // ensure output file does not already exist.
-        std::filesystem::path outfile_system_path { outfilepath };
-        if (std::filesystem::exists(outfile_system_path))
+        if (!check_output_path(infilepath, outfilepath, opts))
+        {
+            return false;
+        }
+
+        if (opts.compress)
+        {
+            outfile.open(outfilepath, std::ios::out | std::ios::binary | std::ios::trunc);
+        }
+        else
+        {
+            opts.decompress_path = outfilepath;
+        }
+    }
+    else
+    {
+        // without a path we filter standard input to standard output.
+        if (opts.extract_range)
         {
-            std::cerr << "Error: the file " << outfilepath << " already exists. Delete or rename this file before proceeding\n";
+            std::cerr << "Error: --range needs a .jzip file path.\n";
             return false;
         }
+        if (!input.open_fd(STDIN_FILENO))
+        {
+            std::cerr << "Error: standard input could not be opened.\n";
+            return false;
+        }
+        opts.compress = !opts.force_decompress;
+        opts.to_stdout = true;
+    }
+
+    // compressed data on a terminal is of no use to anyone.
+    if (opts.compress && opts.to_stdout && isatty(STDOUT_FILENO))
+    {
+        std::cerr << "Error: refusing to write compressed data to a terminal, redirect standard output.\n";
+        return false;
+    }
+
+    return true;
+}
+
+// reads a whole sample into memory, from standard input for an empty path.
+bool read_sample(const std::string& path, std::vector<uint8_t>& sample)
+{
+    InputSource input {};
+    const uint8_t* data {};
+    size_t size {};
+    bool ok = path.empty() ? input.open_fd(STDIN_FILENO) : input.open(path);
+    if (!ok || !input.read_span(SIZE_MAX, sample, data, size))
+    {
+        std::cerr << "Error: file " << (path.empty() ? "standard input" : path) << " could not be read.\n";
+        return false;
+    }
+    sample.assign(data, data + size);
+
+    return true;
+}
+
+bool train_dictionary(const Options& opts)
+{
+    std::vector<std::string> paths { opts.sample_paths };
+    if (paths.empty())
+    {
+        paths.push_back("");
+    }
 
-        outfile.open(outfilepath);
+    std::vector<std::vector<uint8_t>> samples(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (!read_sample(paths[i], samples[i]))
+        {
+            return false;
+        }
     }
-    else 
+
+    Dictionary dictionary {};
+    if (!dictionary.train(samples, opts.compress_options.max_code_length) || !write_dictionary_file(opts.train_path, dictionary))
     {
-        std::cerr << "Error: no file path passed.\n";
-        print_usage(std::cerr);
+        return false;
     }
+    std::cerr << "Wrote dictionary " << dictionary.id() << " to " << opts.train_path << "\n";
 
     return true;
 }
 
+void report_stats(const Stats& stats, double seconds, bool json)
+{
+    rusage usage {};
+    long peak_rss_kb { getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0 };
+    if (json)
+    {
+        write_stats_json(std::cerr, stats, seconds, peak_rss_kb);
+    }
+    else
+    {
+        write_stats_text(std::cerr, stats, seconds, peak_rss_kb);
+    }
+}
+
 int main(int argc, char* argv[])
 {
-    // program inputs 
-    std::ifstream infile {};
+    // the streams are only used from C++, unsyncing them lets cout buffer.
+    std::ios::sync_with_stdio(false);
+
+    // program inputs
+    InputSource input {};
     std::ofstream outfile {};
-    bool compress {};
-    
+    Options opts {};
+
     // process args
     bool ok {};
-    ok = process_arguments(infile, outfile, compress, argc, argv);
+    ok = process_arguments(input, outfile, opts, argc, argv);
     if (!ok)
     {
         return 1;
     }
 
-    if (compress)
+    if (!opts.train_path.empty())
+    {
+        return train_dictionary(opts) ? 0 : 1;
+    }
+
+    // the dictionary is loaded once, with its tables, for every block of the file.
+    Dictionary dictionary {};
+    if (!opts.dictionary_path.empty())
+    {
+        if (!read_dictionary_file(opts.dictionary_path, dictionary))
+        {
+            return 1;
+        }
+        opts.compress_options.dictionary = &dictionary;
+        opts.decompress_options.dictionary = &dictionary;
+    }
+
+    if (opts.batch)
     {
-        ok = compress_file(infile, outfile);
+        ok = process_batch(opts.batch_files, opts.compress_options, opts.decompress_options);
+        return ok && !opts.batch_incomplete ? 0 : 1;
+    }
+
+    std::ostream* output { opts.to_stdout ? static_cast<std::ostream*>(&std::cout) : &outfile };
+
+    // the stats cover the whole run, from the first read to the last write.
+    Stats stats {};
+    if (opts.stats)
+    {
+        opts.compress_options.stats = &stats;
+        opts.decompress_options.stats = &stats;
+    }
+    auto start { std::chrono::steady_clock::now() };
+
+    if (opts.extract_range)
+    {
+        ok = decompress_range(input, *output, opts.range_offset, opts.range_length, opts.decompress_options);
+    }
+    else if (opts.compress)
+    {
+        ok = compress_file(input, *output, opts.compress_options);
+    }
+    else if (!opts.decompress_path.empty())
+    {
+        ok = decompress_file(input, opts.decompress_path, opts.decompress_options);
     }
     else
     {
-        ok = decompress_file(infile, outfile);
+        ok = decompress_file(input, *output, opts.decompress_options);
+    }
+
+    output->flush();
+    if (!*output)
+    {
+        std::cerr << "Error: failed to write output.\n";
+        ok = false;
+    }
+
+    if (ok && opts.stats)
+    {
+        report_stats(stats, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), opts.stats_json);
     }
 
     return ok ? 0 : 1;
-}
\ No newline at end of file
+}
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cstring>
+
+#include "lz77.h"
+
+constexpr int HASH_BITS { 16 };
+constexpr uint32_t NO_POSITION { UINT32_MAX };
+
+struct LevelParams
+{
+    int max_chain;   // candidates tried per position
+    int good_length; // the lookahead search tries a quarter of the chain after a match this long
+    int max_lazy;    // no lookahead after a match this long. Greedy levels don't hash 
+                     // the positions inside matches longer than this instead.
+    int nice_length; // a match this long ends the search
+    bool lazy;       // look one byte ahead for a longer match
+};
+
+// the zlib levels: low levels take the first good match, high levels search long 
+// chains and defer to longer matches.
+constexpr LevelParams LEVELS[MAX_LEVEL + 1] {
+    {},
+    { 4, 4, 4, 8, false },
+    { 8, 4, 5, 16, false },
+    { 32, 4, 6, 32, false },
+    { 16, 4, 4, 16, true },
+    { 32, 8, 16, 32, true },
+    { 128, 8, 16, 128, true },
+    { 256, 8, 32, 128, true },
+    { 1024, 32, 128, 258, true },
+    { 4096, 32, 258, 258, true },
+};
+
+struct Match
+{
+    size_t length {};
+    size_t distance {};
+};
+
+inline uint32_t hash_prefix(const uint8_t* data)
+{
+    uint32_t word {};
+    std::memcpy(&word, data, sizeof(word));
+    return (word * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// length of the common prefix of a and b, at most max_length.
+inline size_t common_prefix_length(const uint8_t* a, const uint8_t* b, size_t max_length)
+{
+    size_t length { 0 };
+    while (length + 8 <= max_length)
+    {
+        uint64_t x {};
+        uint64_t y {};
+        std::memcpy(&x, a + length, sizeof(x));
+        std::memcpy(&y, b + length, sizeof(y));
+        if (x != y)
+        {
+            return length + __builtin_ctzll(x ^ y) / 8;
+        }
+        length += 8;
+    }
+    while (length < max_length && a[length] == b[length])
+    {
+        ++length;
+    }
+    return length;
+}
+
+void write_length_rest(std::vector<uint8_t>& lengths, size_t rest)
+{
+    for (; rest >= 255; rest -= 255)
+    {
+        lengths.push_back(255);
+    }
+    lengths.push_back(rest);
+}
+
+bool read_length_rest(const std::vector<uint8_t>& lengths, size_t& pos, size_t& length)
+{
+    uint8_t byte {};
+    do
+    {
+        if (pos >= lengths.size())
+        {
+            return false;
+        }
+        byte = lengths[pos++];
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+void emit_sequence(LzStreams& streams, const uint8_t* literals, size_t literal_length, const Match& match, int window_bits)
+{
+    size_t match_rest { match.length ? match.length - MIN_MATCH : 0 };
+    streams.tokens.push_back((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_rest, 15));
+    if (literal_length >= 15)
+    {
+        write_length_rest(streams.lengths, literal_length - 15);
+    }
+    streams.literals.insert(streams.literals.end(), literals, literals + literal_length);
+
+    if (match.length == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < offset_bytes(window_bits); ++i)
+    {
+        streams.offsets.push_back(static_cast<uint8_t>(match.distance >> (8 * i)));
+    }
+    if (match_rest >= 15)
+    {
+        write_length_rest(streams.lengths, match_rest - 15);
+    }
+}
+
+void LzStreams::clear()
+{
+    literals.clear();
+    tokens.clear();
+    offsets.clear();
+    lengths.clear();
+}
+
+void MatchFinder::parse(const uint8_t* data, size_t size, int level, int window_bits, LzStreams& streams)
+{
+    const LevelParams& params { LEVELS[std::clamp(level, MIN_LEVEL, MAX_LEVEL)] };
+    const size_t window { size_t { 1 } << window_bits };
+    const size_t window_mask { window - 1 };
+
+    streams.clear();
+    m_head.assign(size_t { 1 } << HASH_BITS, NO_POSITION);
+    m_prev.resize(std::min(window, std::max<size_t>(size, 1)));
+    const size_t prev_mask { m_prev.size() == window ? window_mask : SIZE_MAX };
+
+    // positions are hashed in order, each after searching it so it never matches itself.
+    size_t next_insert { 0 };
+    auto insert_up_to = [&](size_t end)
+    {
+        end = std::min(end, size - MIN_MATCH + 1);
+        for (; next_insert < end; ++next_insert)
+        {
+            uint32_t& head { m_head[hash_prefix(data + next_insert)] };
+            m_prev[next_insert & prev_mask] = head;
+            head = next_insert;
+        }
+    };
+
+    auto find_match = [&](size_t pos, int max_chain)
+    {
+        // candidates are compared up to nice_length only, a match that gets there 
+        // ends the search and is extended once afterwards. Repetitive input would 
+        // otherwise compare far ahead for every candidate.
+        Match best {};
+        size_t max_length { std::min<size_t>(size - pos, params.nice_length) };
+        size_t best_length { MIN_MATCH - 1 };
+        int chain { max_chain };
+        uint32_t candidate { m_head[hash_prefix(data + pos)] };
+
+        // chains run back in time. A link that doesn't lead further back points
+        // at a slot reused since, so the chain ends there.
+        while (candidate != NO_POSITION && pos - candidate < window && chain-- > 0)
+        {
+            if (data[candidate + best_length] == data[pos + best_length])
+            {
+                size_t length { common_prefix_length(data + candidate, data + pos, max_length) };
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best = Match { length, pos - candidate };
+                    if (length == max_length)
+                    {
+                        break;
+                    }
+                }
+            }
+            uint32_t next { m_prev[candidate & prev_mask] };
+            if (next == NO_POSITION || next >= candidate)
+            {
+                break;
+            }
+            candidate = next;
+        }
+
+        if (best.length == max_length)
+        {
+            size_t rest { size - pos - max_length };
+            best.length += common_prefix_length(data + pos - best.distance + max_length, data + pos + max_length, rest);
+        }
+
+        return best;
+    };
+
+    size_t literal_start { 0 };
+    size_t pos { 0 };
+    while (pos + MIN_MATCH <= size)
+    {
+        Match match { find_match(pos, params.max_chain) };
+        insert_up_to(pos + 1);
+
+        while (params.lazy && match.length && match.length < static_cast<size_t>(params.max_lazy) && pos + 1 + MIN_MATCH <= size)
+        {
+            int max_chain { match.length >= static_cast<size_t>(params.good_length) ? params.max_chain / 4 : params.max_chain };
+            Match next { find_match(pos + 1, max_chain) };
+            insert_up_to(pos + 2);
+            if (next.length <= match.length)
+            {
+                break;
+            }
+            ++pos;
+            match = next;
+        }
+
+        if (match.length == 0)
+        {
+            ++pos;
+            continue;
+        }
+
+        emit_sequence(streams, data + literal_start, pos - literal_start, match, window_bits);
+        pos += match.length;
+        literal_start = pos;
+        if (params.lazy || match.length <= static_cast<size_t>(params.max_lazy))
+        {
+            insert_up_to(pos);
+        }
+        else
+        {
+            next_insert = std::max(next_insert, pos);
+        }
+    }
+
+    if (literal_start < size)
+    {
+        emit_sequence(streams, data + literal_start, size - literal_start, Match {}, window_bits);
+    }
+}
+
+bool expand_sequences(const LzStreams& streams, int window_bits, uint8_t* out, size_t out_size)
+{
+    const int distance_bytes { offset_bytes(window_bits) };
+    size_t pos { 0 };
+    size_t literal_pos { 0 };
+    size_t offset_pos { 0 };
+    size_t length_pos { 0 };
+
+    for (size_t token = 0; token < streams.tokens.size(); ++token)
+    {
+        size_t literal_length { static_cast<size_t>(streams.tokens[token] >> 4) };
+        if (literal_length == 15 && !read_length_rest(streams.lengths, length_pos, literal_length))
+        {
+            return false;
+        }
+        if (literal_length > streams.literals.size() - literal_pos || literal_length > out_size - pos)
+        {
+            return false;
+        }
+        std::memcpy(out + pos, streams.literals.data() + literal_pos, literal_length);
+        literal_pos += literal_length;
+        pos += literal_length;
+
+        // only the last sequence may end without a match, when its literals fill the block.
+        if (pos == out_size)
+        {
+            if (token + 1 != streams.tokens.size() || (streams.tokens[token] & 15) != 0)
+            {
+                return false;
+            }
+            break;
+        }
+
+        size_t match_length { static_cast<size_t>(streams.tokens[token] & 15) };
+        if (match_length == 15 && !read_length_rest(streams.lengths, length_pos, match_length))
+        {
+            return false;
+        }
+        match_length += MIN_MATCH;
+
+        if (streams.offsets.size() - offset_pos < static_cast<size_t>(distance_bytes))
+        {
+            return false;
+        }
+        size_t distance { 0 };
+        for (int i = 0; i < distance_bytes; ++i)
+        {
+            distance |= static_cast<size_t>(streams.offsets[offset_pos++]) << (8 * i);
+        }
+        if (distance == 0 || distance > pos || match_length > out_size - pos)
+        {
+            return false;
+        }
+
+        // matches may overlap their own output, a distance of 1 repeats one byte.
+        // Copies of 8 bytes are safe as long as they don't reach into themselves.
+        uint8_t* dst { out + pos };
+        const uint8_t* src { dst - distance };
+        size_t i { 0 };
+        if (distance >= 8)
+        {
+            for (; i + 8 <= match_length; i += 8)
+            {
+                std::memcpy(dst + i, src + i, 8);
+            }
+        }
+        for (; i < match_length; ++i)
+        {
+            dst[i] = src[i];
+        }
+        pos += match_length;
+    }
+
+    return pos == out_size && literal_pos == streams.literals.size() && offset_pos == streams.offsets.size()
+        && length_pos == streams.lengths.size();
+}
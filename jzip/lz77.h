@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LZ77 front end. A block is parsed into sequences, each a run of literal bytes
+// followed by a match copying earlier output. The sequences are split into four
+// byte streams which are then entropy coded like any other block:
+//
+//   literals: the literal bytes of all sequences
+//   tokens:   one byte per sequence, literal run length in the high nibble and
+//             match length - MIN_MATCH in the low nibble. 15 means the rest of
+//             the length follows in the lengths stream.
+//   offsets:  match distances, little endian, offset_bytes(window_bits) each
+//   lengths:  the rest of long lengths as a run of 255s ended by a smaller byte
+//
+// A block that ends in literals ends with a sequence without a match, which the
+// decoder recognises by the block being full after its literals.
+
+constexpr int MIN_MATCH { 4 };
+constexpr int MIN_LEVEL { 1 };
+constexpr int MAX_LEVEL { 9 };
+constexpr int MIN_WINDOW_BITS { 10 };
+constexpr int MAX_WINDOW_BITS { 24 };
+constexpr int DEFAULT_WINDOW_BITS { 16 };
+
+// match distances are below 1 << window_bits.
+inline int offset_bytes(int window_bits)
+{
+    return (window_bits + 7) / 8;
+}
+
+struct LzStreams
+{
+    std::vector<uint8_t> literals {};
+    std::vector<uint8_t> tokens {};
+    std::vector<uint8_t> offsets {};
+    std::vector<uint8_t> lengths {};
+
+    void clear();
+};
+
+// Hash chain match finder. The head of each chain is the latest position whose
+// first MIN_MATCH bytes hash to it, and m_prev links every position to the one
+// before it with the same hash. Higher levels follow the chains further and look
+// one byte ahead for a longer match before taking one (lazy matching). The tables
+// are kept between blocks, so a finder should be reused.
+class MatchFinder
+{
+private:
+    std::vector<uint32_t> m_head {};
+    std::vector<uint32_t> m_prev {};
+
+public:
+    void parse(const uint8_t* data, size_t size, int level, int window_bits, LzStreams& streams);
+};
+
+bool expand_sequences(const LzStreams& streams, int window_bits, uint8_t* out, size_t out_size);
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reading, coding and writing of a file's blocks as three overlapping stages.
+// The calling thread reads each block into a free job from a ring and hands it
+// to a pool, and a writer thread of the pipeline's own waits for the jobs in ring
+// order and writes them out. A slow read then no longer holds up writing, or the
+// other way round, while the pool codes the blocks in between. The ring bounds
+// memory: when every job is in flight, the reader waits for the writer.
+//
+// Job needs a done future, set by whoever submits it, that tells whether coding
+// it succeeded.
+template <typename Job>
+class BlockPipeline
+{
+private:
+    std::vector<Job> m_jobs;
+    std::function<bool(Job&)> m_write;
+    std::mutex m_mutex {};
+    std::condition_variable m_condition {};
+    size_t m_submitted {}; // jobs handed to the writer, all time
+    size_t m_written {};   // jobs the writer is done with, all time
+    bool m_closed {};
+    bool m_failed {};
+    std::thread m_writer {};
+
+    void run_writer()
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock { m_mutex };
+                m_condition.wait(lock, [this]() { return m_closed || m_written < m_submitted; });
+                if (m_written == m_submitted)
+                {
+                    return;
+                }
+            }
+
+            // after a failure the remaining jobs are only waited on, as their
+            // buffers may still be in use.
+            Job& job { m_jobs[m_written % m_jobs.size()] };
+            bool ok { job.done.get() };
+            {
+                std::lock_guard<std::mutex> lock { m_mutex };
+                ok = ok && !m_failed;
+            }
+            ok = ok && m_write(job);
+
+            {
+                std::lock_guard<std::mutex> lock { m_mutex };
+                m_failed = m_failed || !ok;
+                ++m_written;
+            }
+            m_condition.notify_all();
+        }
+    }
+
+public:
+    // depth jobs are in flight at most. write is called on the writer thread, in
+    // order, for every job that was coded.
+    BlockPipeline(size_t depth, std::function<bool(Job&)> write)
+        : m_jobs(std::max<size_t>(depth, 2))
+        , m_write { std::move(write) }
+        , m_writer { [this]() { run_writer(); } }
+    {
+    }
+
+    ~BlockPipeline()
+    {
+        finish();
+    }
+
+    BlockPipeline(const BlockPipeline&) = delete;
+    BlockPipeline& operator= (const BlockPipeline&) = delete;
+
+    // the next job to fill, once the writer is done with its last use. Null after
+    // a job failed, as nothing more will be written.
+    Job* next()
+    {
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_condition.wait(lock, [this]() { return m_failed || m_submitted - m_written < m_jobs.size(); });
+        return m_failed ? nullptr : &m_jobs[m_submitted % m_jobs.size()];
+    }
+
+    // queues the job returned by next(), after its done future has been set.
+    void submit()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            ++m_submitted;
+        }
+        m_condition.notify_all();
+    }
+
+    // waits until every submitted job is written. Fails if any job failed.
+    bool finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_closed = true;
+        }
+        m_condition.notify_all();
+        if (m_writer.joinable())
+        {
+            m_writer.join();
+        }
+
+        return !m_failed;
+    }
+};
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+#include "stats.h"
+
+void Stats::add(const Stats& other)
+{
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        phase_nanoseconds[phase] += other.phase_nanoseconds[phase];
+    }
+    input_bytes += other.input_bytes;
+    output_bytes += other.output_bytes;
+    blocks += other.blocks;
+    for (size_t method = 0; method < METHOD_SLOTS; ++method)
+    {
+        method_blocks[method] += other.method_blocks[method];
+        method_raw_bytes[method] += other.method_raw_bytes[method];
+        method_coded_bytes[method] += other.method_coded_bytes[method];
+    }
+    block_buffer_bytes = std::max(block_buffer_bytes, other.block_buffer_bytes);
+    jobs_in_flight = std::max(jobs_in_flight, other.jobs_in_flight);
+}
+
+void Stats::add_block(uint8_t method, uint64_t raw_bytes, uint64_t coded_bytes)
+{
+    ++blocks;
+    if (method < METHOD_SLOTS)
+    {
+        ++method_blocks[method];
+        method_raw_bytes[method] += raw_bytes;
+        method_coded_bytes[method] += coded_bytes;
+    }
+}
+
+PhaseTimer::PhaseTimer(Stats* stats, Phase phase)
+    : m_stats { stats }
+    , m_phase { phase }
+{
+    if (m_stats)
+    {
+        m_start = std::chrono::steady_clock::now();
+    }
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (m_stats)
+    {
+        next(m_phase);
+    }
+}
+
+void PhaseTimer::next(Phase phase)
+{
+    if (!m_stats)
+    {
+        return;
+    }
+
+    auto now { std::chrono::steady_clock::now() };
+    m_stats->phase_nanoseconds[static_cast<size_t>(m_phase)] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start).count();
+    m_phase = phase;
+    m_start = now;
+}
+
+const char* phase_name(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::read:
+        return "read";
+    case Phase::count:
+        return "count";
+    case Phase::match:
+        return "match";
+    case Phase::tables:
+        return "tables";
+    case Phase::encode:
+        return "encode";
+    case Phase::decode:
+        return "decode";
+    case Phase::write:
+        return "write";
+    }
+    return "unknown";
+}
+
+const char* block_method_name(uint8_t method)
+{
+    constexpr const char* NAMES[METHOD_SLOTS] {
+        "none", "huffman", "adaptive", "huffman_streams", "lz77", "tans", "huffman_order1",
+        "dictionary_huffman", "dictionary_order1", "stored",
+    };
+    return method < METHOD_SLOTS && NAMES[method] ? NAMES[method] : "unknown";
+}
+
+double bits_per_byte(uint64_t coded_bytes, uint64_t raw_bytes)
+{
+    return raw_bytes > 0 ? 8.0 * coded_bytes / raw_bytes : 0.0;
+}
+
+double throughput_mb_s(uint64_t bytes, double seconds)
+{
+    return seconds > 0 ? bytes / seconds / 1e6 : 0.0;
+}
+
+void write_stats_text(std::ostream& out, const Stats& stats, double seconds, long peak_rss_kb)
+{
+    std::ios::fmtflags flags { out.flags() };
+    out << std::fixed << std::setprecision(3);
+
+    out << "input:  " << stats.input_bytes << " bytes\n"
+        << "output: " << stats.output_bytes << " bytes, " << bits_per_byte(stats.output_bytes, stats.input_bytes) << " bits per input byte\n"
+        << "time:   " << seconds << " s, " << throughput_mb_s(stats.input_bytes, seconds) << " MB/s of input\n"
+        << "memory: " << peak_rss_kb << " KiB peak RSS";
+    if (stats.block_buffer_bytes > 0)
+    {
+        out << ", " << stats.jobs_in_flight << " block jobs of up to " << stats.block_buffer_bytes << " bytes of buffers";
+    }
+    out << "\n";
+
+    // thread time, so with several threads the phases add up to more than the run.
+    out << "phases (thread seconds):\n";
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        if (stats.phase_nanoseconds[phase] > 0)
+        {
+            out << "  " << std::left << std::setw(8) << phase_name(static_cast<Phase>(phase)) << std::right
+                << std::setw(10) << stats.phase_nanoseconds[phase] / 1e9 << "\n";
+        }
+    }
+
+    out << "blocks: " << stats.blocks << "\n";
+    for (size_t method = 0; method < METHOD_SLOTS; ++method)
+    {
+        if (stats.method_blocks[method] > 0)
+        {
+            out << "  " << std::left << std::setw(20) << block_method_name(method) << std::right
+                << std::setw(8) << stats.method_blocks[method] << " blocks "
+                << std::setw(14) << stats.method_raw_bytes[method] << " -> " << std::setw(14) << stats.method_coded_bytes[method]
+                << " bytes, " << bits_per_byte(stats.method_coded_bytes[method], stats.method_raw_bytes[method]) << " bits per byte\n";
+        }
+    }
+
+    out.flags(flags);
+}
+
+void write_stats_json(std::ostream& out, const Stats& stats, double seconds, long peak_rss_kb)
+{
+    out << "{ \"input_bytes\": " << stats.input_bytes << ", \"output_bytes\": " << stats.output_bytes
+        << ", \"bits_per_byte\": " << bits_per_byte(stats.output_bytes, stats.input_bytes)
+        << ", \"seconds\": " << seconds << ", \"mb_s\": " << throughput_mb_s(stats.input_bytes, seconds)
+        << ", \"peak_rss_kb\": " << peak_rss_kb << ", \"jobs_in_flight\": " << stats.jobs_in_flight
+        << ", \"block_buffer_bytes\": " << stats.block_buffer_bytes << ", \"phase_seconds\": {";
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        out << (phase > 0 ? ", \"" : " \"") << phase_name(static_cast<Phase>(phase)) << "\": " << stats.phase_nanoseconds[phase] / 1e9;
+    }
+    out << " }, \"blocks\": " << stats.blocks << ", \"methods\": [";
+    bool first { true };
+    for (size_t method = 0; method < METHOD_SLOTS; ++method)
+    {
+        if (stats.method_blocks[method] > 0)
+        {
+            out << (first ? "" : ",") << "\n    { \"method\": \"" << block_method_name(method) << "\", \"blocks\": " << stats.method_blocks[method]
+                << ", \"raw_bytes\": " << stats.method_raw_bytes[method] << ", \"coded_bytes\": " << stats.method_coded_bytes[method]
+                << ", \"bits_per_byte\": " << bits_per_byte(stats.method_coded_bytes[method], stats.method_raw_bytes[method]) << " }";
+            first = false;
+        }
+    }
+    out << (first ? "] }\n" : "\n  ] }\n");
+}
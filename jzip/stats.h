@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+// Counters and phase times of compressing or decompressing, collected when the
+// options point to a Stats. Every block job fills in its own, which the thread
+// writing the blocks out adds up, so nothing is shared while blocks are coded.
+// Times are taken once per phase of a block, and not at all without a Stats.
+enum class Phase
+{
+    read,   // reading input, or waiting for it to arrive
+    count,  // byte and byte pair histograms
+    match,  // LZ77 parsing
+    tables, // building and weighing code tables
+    encode, // writing the coded bytes
+    decode, // decoding blocks, their tables included
+    write,  // writing output
+};
+
+constexpr size_t PHASE_COUNT { 7 };
+constexpr size_t METHOD_SLOTS { 16 }; // by BlockMethod value
+
+struct Stats
+{
+    std::array<uint64_t, PHASE_COUNT> phase_nanoseconds {}; // summed over threads
+    uint64_t input_bytes {};
+    uint64_t output_bytes {};
+    uint64_t blocks {};
+    std::array<uint64_t, METHOD_SLOTS> method_blocks {};
+    std::array<uint64_t, METHOD_SLOTS> method_raw_bytes {};
+    std::array<uint64_t, METHOD_SLOTS> method_coded_bytes {};
+    uint64_t block_buffer_bytes {}; // the most any one block job held in buffers
+    int jobs_in_flight {};
+
+    void add(const Stats& other);
+    // counts a block, header included in coded_bytes.
+    void add_block(uint8_t method, uint64_t raw_bytes, uint64_t coded_bytes);
+};
+
+// times one phase after another into stats, from construction to destruction.
+// Does nothing when stats is null.
+class PhaseTimer
+{
+private:
+    Stats* m_stats {};
+    Phase m_phase {};
+    std::chrono::steady_clock::time_point m_start {};
+
+public:
+    PhaseTimer(Stats* stats, Phase phase);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator= (const PhaseTimer&) = delete;
+
+    // ends the current phase and starts the given one.
+    void next(Phase phase);
+};
+
+const char* phase_name(Phase phase);
+const char* block_method_name(uint8_t method);
+
+// the report of jzip --stats, for people or as a JSON object. seconds is the wall
+// time of the whole run and peak_rss_kb the process' peak memory, 0 if unknown.
+void write_stats_text(std::ostream& out, const Stats& stats, double seconds, long peak_rss_kb);
+void write_stats_json(std::ostream& out, const Stats& stats, double seconds, long peak_rss_kb);
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cmath>
+
+#include "tans.h"
+
+int floor_log2(uint32_t value)
+{
+    return 31 - __builtin_clz(value);
+}
+
+// deals the states out to the symbols, each getting as many as its count. The
+// step is odd, so it visits every state of the power of two sized table once,
+// and it scatters each symbol's states evenly over the table.
+bool spread_symbols(const NormalizedCounts& counts, int table_log, std::vector<uint8_t>& spread)
+{
+    const uint32_t table_size { 1u << table_log };
+    const uint32_t mask { table_size - 1 };
+    const uint32_t step { (table_size >> 1) + (table_size >> 3) + 3 };
+
+    uint32_t total { 0 };
+    for (uint16_t count : counts)
+    {
+        total += count;
+    }
+    if (total != table_size)
+    {
+        return false;
+    }
+
+    spread.resize(table_size);
+    uint32_t position { 0 };
+    for (size_t symbol = 0; symbol < counts.size(); ++symbol)
+    {
+        for (uint16_t i = 0; i < counts[symbol]; ++i)
+        {
+            spread[position] = symbol;
+            position = (position + step) & mask;
+        }
+    }
+
+    return true;
+}
+
+int choose_table_log(const ByteHistogram& histogram, uint64_t total)
+{
+    // about two states per symbol at least, and not many more states than bytes.
+    int table_log { DEFAULT_TABLE_LOG };
+    while (table_log > MIN_TABLE_LOG && (uint64_t { 1 } << (table_log - 1)) >= total)
+    {
+        --table_log;
+    }
+    while (table_log < MAX_TABLE_LOG && (1 << table_log) < 2 * count_symbols(histogram))
+    {
+        ++table_log;
+    }
+    return table_log;
+}
+
+bool normalize_counts(const ByteHistogram& counted, int table_log, NormalizedCounts& counts)
+{
+    // bounded, so count * table_size below fits in 64 bits.
+    ByteHistogram scaled {};
+    const ByteHistogram& histogram { bound_histogram(counted, MAX_CODE_TOTAL, scaled) };
+    const int64_t table_size { int64_t { 1 } << table_log };
+    uint64_t total { 0 };
+    for (uint64_t count : histogram)
+    {
+        total += count;
+    }
+    if (total == 0 || table_log < MIN_TABLE_LOG || table_log > MAX_TABLE_LOG || count_symbols(histogram) > table_size)
+    {
+        return false;
+    }
+
+    // scale down, keeping every present symbol at 1 or more.
+    int64_t sum { 0 };
+    counts.fill(0);
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        if (histogram[symbol] > 0)
+        {
+            counts[symbol] = std::max<uint64_t>(1, histogram[symbol] * table_size / total);
+            sum += counts[symbol];
+        }
+    }
+
+    // the rounding is fixed up one state at a time, always where it costs the fewest
+    // bits: adding a state to a symbol seen n times with count c saves n * log2((c + 1) / c).
+    while (sum != table_size)
+    {
+        bool grow { sum < table_size };
+        int best { -1 };
+        double best_gain { -INFINITY };
+        for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+        {
+            uint16_t count { counts[symbol] };
+            if (count == 0 || (!grow && count == 1))
+            {
+                continue;
+            }
+            double gain { grow ? histogram[symbol] * std::log2((count + 1.0) / count)
+                               : -(histogram[symbol] * std::log2(count / (count - 1.0))) };
+            if (gain > best_gain)
+            {
+                best_gain = gain;
+                best = symbol;
+            }
+        }
+        counts[best] += grow ? 1 : -1;
+        sum += grow ? 1 : -1;
+    }
+
+    return true;
+}
+
+uint64_t get_tans_bit_count(const ByteHistogram& histogram, const NormalizedCounts& counts, int table_log)
+{
+    double bits { 2.0 * table_log };
+    for (size_t symbol = 0; symbol < histogram.size(); ++symbol)
+    {
+        if (histogram[symbol] > 0)
+        {
+            bits += histogram[symbol] * (table_log - std::log2(counts[symbol]));
+        }
+    }
+    return static_cast<uint64_t>(std::ceil(bits));
+}
+
+bool TansEncodeTable::build(const NormalizedCounts& counts, int table_log)
+{
+    std::vector<uint8_t>& spread { m_spread };
+    if (table_log < MIN_TABLE_LOG || table_log > MAX_TABLE_LOG || !spread_symbols(counts, table_log, spread))
+    {
+        return false;
+    }
+    const uint32_t table_size { 1u << table_log };
+    m_table_log = table_log;
+
+    // each symbol owns a slice of m_states listing its states in table order.
+    std::array<uint32_t, 256> starts {};
+    uint32_t start { 0 };
+    for (size_t symbol = 0; symbol < counts.size(); ++symbol)
+    {
+        starts[symbol] = start;
+        start += counts[symbol];
+    }
+
+    m_states.resize(table_size);
+    std::array<uint32_t, 256> next { starts };
+    for (uint32_t state = 0; state < table_size; ++state)
+    {
+        m_states[next[spread[state]]++] = table_size + state;
+    }
+
+    // a symbol with count c takes states in [c, 2c) after shifting out its bits,
+    // so it writes bits or bits - 1 of them depending on the state.
+    for (size_t symbol = 0; symbol < counts.size(); ++symbol)
+    {
+        uint32_t count { counts[symbol] };
+        if (count == 0)
+        {
+            continue;
+        }
+        uint32_t bits = count == 1 ? table_log : table_log - floor_log2(count - 1);
+        m_transforms[symbol].delta_bits = (bits << 16) - (count << bits);
+        m_transforms[symbol].delta_state = static_cast<int32_t>(starts[symbol]) - static_cast<int32_t>(count);
+    }
+
+    return true;
+}
+
+void TansEncodeTable::encode(const uint8_t* data, size_t size, BitWriter& writer, std::vector<uint16_t>& scratch) const
+{
+    const uint32_t table_size { 1u << m_table_log };
+    uint32_t even_state { table_size };
+    uint32_t odd_state { table_size };
+
+    // the bits for each symbol are kept with their count in the top 4 bits, and
+    // written out in order once both states have reached the start of the data.
+    scratch.resize(size);
+    auto encode_symbol = [&](uint32_t& state, size_t i)
+    {
+        const SymbolTransform& transform { m_transforms[data[i]] };
+        uint32_t bits { (state + transform.delta_bits) >> 16 };
+        scratch[i] = (state & ((1u << bits) - 1)) | (bits << 12);
+        state = m_states[(state >> bits) + transform.delta_state];
+    };
+
+    size_t i { size };
+    if (i & 1)
+    {
+        encode_symbol(even_state, --i);
+    }
+    while (i > 0)
+    {
+        i -= 2;
+        encode_symbol(odd_state, i + 1);
+        encode_symbol(even_state, i);
+    }
+
+    writer.write(even_state - table_size, m_table_log);
+    writer.write(odd_state - table_size, m_table_log);
+    for (uint16_t symbol_bits : scratch)
+    {
+        writer.write(symbol_bits & 0xfff, symbol_bits >> 12);
+    }
+}
+
+bool TansDecodeTable::build(const NormalizedCounts& counts, int table_log)
+{
+    std::vector<uint8_t>& spread { m_spread };
+    if (table_log < MIN_TABLE_LOG || table_log > MAX_TABLE_LOG || !spread_symbols(counts, table_log, spread))
+    {
+        return false;
+    }
+    const uint32_t table_size { 1u << table_log };
+    m_table_log = table_log;
+
+    // the k-th state of a symbol with count c reads enough bits to get back into
+    // [table_size, 2 * table_size) from c + k.
+    std::array<uint32_t, 256> next {};
+    std::copy(counts.begin(), counts.end(), next.begin());
+    m_entries.resize(table_size);
+    for (uint32_t state = 0; state < table_size; ++state)
+    {
+        uint8_t symbol { spread[state] };
+        uint32_t x { next[symbol]++ };
+        uint8_t bits = table_log - floor_log2(x);
+        m_entries[state] = Entry { static_cast<uint16_t>((x << bits) - table_size), symbol, bits };
+    }
+
+    return true;
+}
+
+bool TansDecodeTable::decode(BitReader& reader, uint8_t* out, size_t out_size) const
+{
+    const Entry* entries { m_entries.data() };
+    reader.refill();
+    uint32_t even_state { reader.peek(m_table_log) };
+    reader.consume(m_table_log);
+    uint32_t odd_state { reader.peek(m_table_log) };
+    reader.consume(m_table_log);
+
+    auto decode_symbol = [&](uint32_t& state, uint8_t& symbol)
+    {
+        Entry entry { entries[state] };
+        symbol = entry.symbol;
+        state = entry.base + reader.peek_any(entry.bits);
+        reader.consume(entry.bits);
+    };
+
+    // two symbols read at most 2 * MAX_TABLE_LOG bits, well within one refill.
+    size_t i { 0 };
+    for (; i + 2 <= out_size; i += 2)
+    {
+        reader.refill();
+        decode_symbol(even_state, out[i]);
+        decode_symbol(odd_state, out[i + 1]);
+    }
+    if (i < out_size)
+    {
+        reader.refill();
+        decode_symbol(even_state, out[i]);
+    }
+
+    return even_state == 0 && odd_state == 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bitstream.h"
+#include "histogram.h"
+
+// Table based asymmetric numeral systems (tANS), the entropy coder behind FSE.
+// Symbol counts are scaled to sum to 1 << table_log, and a symbol with count c
+// costs close to table_log - log2(c) bits, fractions included. Huffman codes
+// round every cost up to whole bits, which shows on skewed distributions.
+//
+// Encoding runs backwards over the data, so the decoder can run forwards. Two
+// states take turns on even and odd symbols so that the decoder's table lookups
+// overlap. The stream holds both final encoder states, then the bits of every
+// symbol in order. A valid stream decodes back to the initial states, both 0.
+
+constexpr int MIN_TABLE_LOG { 5 };
+constexpr int MAX_TABLE_LOG { 12 };
+constexpr int DEFAULT_TABLE_LOG { 11 };
+
+// counts scaled to sum to 1 << table_log, 0 for bytes that do not occur.
+using NormalizedCounts = std::array<uint16_t, 256>;
+
+// a table no larger than the data needs, but with room for every symbol.
+int choose_table_log(const ByteHistogram& histogram, uint64_t total);
+bool normalize_counts(const ByteHistogram& histogram, int table_log, NormalizedCounts& counts);
+uint64_t get_tans_bit_count(const ByteHistogram& histogram, const NormalizedCounts& counts, int table_log);
+
+class TansEncodeTable
+{
+private:
+    struct SymbolTransform
+    {
+        uint32_t delta_bits {};  // (bits << 16) - (count << bits), bits out is (state + delta_bits) >> 16
+        int32_t delta_state {};  // start of the symbol's slice of m_states, less its count
+    };
+
+    int m_table_log {};
+    std::vector<uint16_t> m_states {};
+    std::array<SymbolTransform, 256> m_transforms {};
+    std::vector<uint8_t> m_spread {}; // kept so rebuilding the table doesn't allocate
+
+public:
+    bool build(const NormalizedCounts& counts, int table_log);
+
+    // scratch holds the bits of each symbol while the states run backwards.
+    void encode(const uint8_t* data, size_t size, BitWriter& writer, std::vector<uint16_t>& scratch) const;
+};
+
+class TansDecodeTable
+{
+private:
+    struct Entry
+    {
+        uint16_t base {};  // next state before adding the bits read
+        uint8_t symbol {};
+        uint8_t bits {};
+    };
+
+    int m_table_log {};
+    std::vector<Entry> m_entries {};
+    std::vector<uint8_t> m_spread {}; // kept so rebuilding the table doesn't allocate
+
+public:
+    bool build(const NormalizedCounts& counts, int table_log);
+    bool decode(BitReader& reader, uint8_t* out, size_t out_size) const;
+};
@@ -0,0 +1,70 @@
+#include "test.h"
+
+CompressOptions adaptive_options()
+{
+    CompressOptions options {};
+    options.adaptive = true;
+    options.block_size = 65536;
+    return options;
+}
+
+TEST(adaptive_huffman_round_trips)
+{
+    for (CorpusKind kind : all_corpus_kinds())
+    {
+        CHECK(round_trips(make_corpus(kind, 150000), adaptive_options()));
+    }
+    CHECK(round_trips({}, adaptive_options()));
+    CHECK(round_trips({ 'a' }, adaptive_options()));
+    CHECK(round_trips(std::vector<uint8_t>(100000, 0), adaptive_options()));
+
+    // every byte value once, then a deep tree from doubling weights.
+    std::vector<uint8_t> data {};
+    for (int symbol = 0; symbol < 256; ++symbol)
+    {
+        data.push_back(symbol);
+    }
+    for (int symbol = 0; symbol < 17; ++symbol)
+    {
+        data.insert(data.end(), size_t { 1 } << symbol, static_cast<uint8_t>(symbol));
+    }
+    CHECK(round_trips(data, adaptive_options()));
+}
+
+TEST(adaptive_huffman_coded_blocks)
+{
+    std::vector<uint8_t> packed { compress_bytes(make_corpus(CorpusKind::text, 150000), adaptive_options()) };
+    CHECK(!block_methods(packed).empty());
+    for (BlockMethod method : block_methods(packed))
+    {
+        CHECK(method == BlockMethod::adaptive_huffman);
+    }
+}
+
+TEST(adaptive_huffman_corrupt_input)
+{
+    std::vector<uint8_t> packed { compress_bytes(make_corpus(CorpusKind::text, 100000), adaptive_options()) };
+    CHECK(decompress_corrupt_copies(packed) > 0);
+}
+
+// adaptive codes expand random bytes, which are then stored instead.
+TEST(adaptive_huffman_stores_incompressible_blocks)
+{
+    std::vector<uint8_t> random { make_corpus(CorpusKind::random, 200000) };
+    CompressOptions options { adaptive_options() };
+    std::vector<uint8_t> packed { compress_bytes(random, options) };
+    std::vector<BlockMethod> methods { block_methods(packed) };
+    CHECK(!methods.empty());
+    for (BlockMethod method : methods)
+    {
+        CHECK(method == BlockMethod::stored);
+    }
+    CHECK(packed.size() <= compress_bound(random.size(), options.block_size));
+    CHECK(packed.size() <= random.size() + methods.size() * (BLOCK_HEADER_SIZE + INDEX_ENTRY_SIZE) + FILE_HEADER_SIZE + 1 + FOOTER_SIZE);
+    CHECK(round_trips(random, options));
+
+    // LZ77 sequence streams are entropy coded the same way.
+    options.level = 4;
+    CHECK(round_trips(random, options));
+    CHECK(compress_bytes(random, options).size() <= packed.size());
+}
@@ -0,0 +1,90 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "test.h"
+
+// writes size zero bytes compressed to path without holding them in memory.
+bool write_packed_zeros(const std::string& path, uint64_t size)
+{
+    CompressOptions options {};
+    options.level = 9;
+    CompressContext compressor { options };
+    std::ofstream file { path, std::ios::out | std::ios::binary | std::ios::trunc };
+    StreamSink sink { file };
+    std::vector<uint8_t> zeros(1 << 20);
+    for (uint64_t pushed = 0; pushed < size; pushed += zeros.size())
+    {
+        if (!compressor.push(zeros.data(), zeros.size(), sink))
+        {
+            return false;
+        }
+    }
+    return compressor.finish(sink) && file.good();
+}
+
+long peak_rss_kb()
+{
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+TEST(batch_round_trips_small_and_large_files)
+{
+    TempFile text_file { "text" };
+    TempFile logs_file { "logs" };
+    std::vector<uint8_t> text { make_corpus(CorpusKind::text, 5000) };
+    std::vector<uint8_t> logs { make_corpus(CorpusKind::logs, 3 << 20) };
+    CHECK(text_file.write(text) && logs_file.write(logs));
+
+    CompressOptions compress_options {};
+    compress_options.threads = 2;
+    compress_options.block_size = 1 << 20;
+    std::vector<BatchFile> files {
+        { text_file.path(), text_file.path() + ".jzip", true },
+        { logs_file.path(), logs_file.path() + ".jzip", true },
+    };
+    CHECK(process_batch(files, compress_options, {}));
+
+    for (BatchFile& file : files)
+    {
+        std::swap(file.input_path, file.output_path);
+        file.compress = false;
+    }
+    CHECK(text_file.write({}) && logs_file.write({}));
+    CHECK(process_batch(files, compress_options, {}));
+
+    std::vector<uint8_t> data {};
+    CHECK(text_file.read(data) && data == text);
+    CHECK(logs_file.read(data) && data == logs);
+}
+
+// a compressed file of a few hundred bytes that expands to 64 MiB is treated as 
+// a large file, decoded a block at a time, and not whole into a worker's buffer.
+TEST(batch_decompresses_small_files_with_large_data_in_blocks)
+{
+    constexpr uint64_t DATA_SIZE { 64 << 20 };
+    TempFile packed_file { "zeros.jzip" };
+    TempFile output_file { "zeros" };
+
+    // in a child of its own, so its peak memory covers only the batch.
+    pid_t child { fork() };
+    if (child == 0)
+    {
+        long start_kb { peak_rss_kb() };
+        CompressOptions compress_options {};
+        compress_options.threads = 2;
+        bool ok = write_packed_zeros(packed_file.path(), DATA_SIZE)
+               && process_batch({ { packed_file.path(), output_file.path(), false } }, compress_options, {});
+        _exit(!ok ? 1 : peak_rss_kb() - start_kb > 24 * 1024 ? 2 : 0);
+    }
+
+    int status {};
+    CHECK(child > 0 && waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::vector<uint8_t> data {};
+    CHECK(output_file.read(data) && data.size() == DATA_SIZE && data == std::vector<uint8_t>(DATA_SIZE, 0));
+}
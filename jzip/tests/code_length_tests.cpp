@@ -0,0 +1,40 @@
+#include "test.h"
+
+// a limit too short for a code over every byte of a block stores the block.
+TEST(short_code_length_limit_stores_blocks)
+{
+    std::vector<uint8_t> text { make_corpus(CorpusKind::text, 200000) };
+    CompressOptions options {};
+    options.max_code_length = 2;
+    options.block_size = 65536;
+    std::vector<uint8_t> packed { compress_bytes(text, options) };
+    CHECK(!packed.empty());
+    for (BlockMethod method : block_methods(packed))
+    {
+        CHECK(method == BlockMethod::stored);
+    }
+    CHECK(round_trips(text, options));
+
+    // between the two, some blocks may still fit.
+    for (int max_code_length : { 1, 4, 5, 6 })
+    {
+        options.max_code_length = max_code_length;
+        CHECK(round_trips(text, options));
+        CHECK(round_trips(make_corpus(CorpusKind::binary, 100000), options));
+    }
+}
+
+// a limit that fits the alphabet still codes the block.
+TEST(code_length_limit_fitting_the_alphabet_codes_blocks)
+{
+    std::vector<uint8_t> skewed { make_corpus(CorpusKind::skewed, 100000) };
+    CompressOptions options {};
+    options.max_code_length = 7;
+    std::vector<uint8_t> packed { compress_bytes(skewed, options) };
+    CHECK(!packed.empty() && packed.size() < skewed.size());
+    CHECK(round_trips(skewed, options));
+
+    options.level = 6;
+    options.max_code_length = 9;
+    CHECK(round_trips(make_corpus(CorpusKind::logs, 300000), options));
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "test.h"
+
+// log records of a few hundred bytes, too small to carry tables of their own.
+std::vector<std::vector<uint8_t>> dictionary_samples(uint64_t seed, size_t count)
+{
+    std::vector<uint8_t> logs { make_corpus(CorpusKind::logs, count * 300, seed) };
+    std::vector<std::vector<uint8_t>> samples {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        samples.emplace_back(logs.begin() + i * 300, logs.begin() + (i + 1) * 300);
+    }
+    return samples;
+}
+
+bool train_dictionary(Dictionary& dictionary, uint64_t seed = 1)
+{
+    return dictionary.train(dictionary_samples(seed, 200), DEFAULT_MAX_CODE_LENGTH);
+}
+
+bool has_dictionary_blocks(const std::vector<uint8_t>& packed)
+{
+    for (BlockMethod method : block_methods(packed))
+    {
+        if (method == BlockMethod::dictionary_huffman || method == BlockMethod::dictionary_order1)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(dictionary_round_trips)
+{
+    Dictionary dictionary {};
+    CHECK(train_dictionary(dictionary));
+    CompressOptions options {};
+    options.dictionary = &dictionary;
+
+    size_t dictionary_blocks { 0 };
+    for (const std::vector<uint8_t>& record : dictionary_samples(7, 20))
+    {
+        std::vector<uint8_t> packed { compress_bytes(record, options) };
+        dictionary_blocks += has_dictionary_blocks(packed);
+        CHECK(packed.size() < record.size());
+        CHECK(round_trips(record, options));
+    }
+    CHECK(dictionary_blocks == 20);
+
+    // any data can be coded with the tables, if not well.
+    CHECK(round_trips(make_corpus(CorpusKind::random, 5000), options));
+    CHECK(round_trips(make_corpus(CorpusKind::text, 200000), options));
+    CHECK(round_trips({}, options));
+    options.context_model = true;
+    options.level = 3;
+    CHECK(round_trips(make_corpus(CorpusKind::logs, 200000, 3), options));
+}
+
+TEST(dictionary_file_round_trips)
+{
+    Dictionary dictionary {};
+    CHECK(train_dictionary(dictionary));
+    TempFile file { "logs.dict" };
+    CHECK(write_dictionary_file(file.path(), dictionary));
+
+    Dictionary loaded {};
+    CHECK(read_dictionary_file(file.path(), loaded) && loaded.id() == dictionary.id());
+
+    CompressOptions options {};
+    options.dictionary = &dictionary;
+    std::vector<uint8_t> record { dictionary_samples(9, 1)[0] };
+    std::vector<uint8_t> packed { compress_bytes(record, options) };
+    std::vector<uint8_t> data {};
+    CHECK(decompress_bytes(packed, data, &loaded) && data == record);
+}
+
+TEST(dictionary_must_match_the_file)
+{
+    Dictionary dictionary {};
+    Dictionary other {};
+    CHECK(train_dictionary(dictionary) && other.train({ make_corpus(CorpusKind::binary, 20000) }, DEFAULT_MAX_CODE_LENGTH));
+    CHECK(dictionary.id() != other.id());
+
+    CompressOptions options {};
+    options.dictionary = &dictionary;
+    std::vector<uint8_t> packed { compress_bytes(dictionary_samples(5, 1)[0], options) };
+
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    std::vector<uint8_t> data {};
+    CHECK(!decompress_bytes(packed, data));
+    CHECK(!decompress_bytes(packed, data, &other));
+    std::cerr.rdbuf(errors);
+}
+
+TEST(dictionary_corrupt_input)
+{
+    Dictionary dictionary {};
+    CHECK(train_dictionary(dictionary));
+    CompressOptions options {};
+    options.dictionary = &dictionary;
+    options.context_model = true;
+
+    std::vector<uint8_t> records {};
+    for (const std::vector<uint8_t>& record : dictionary_samples(11, 3))
+    {
+        records.insert(records.end(), record.begin(), record.end());
+    }
+    std::vector<uint8_t> packed { compress_bytes(records, options) };
+    CHECK(has_dictionary_blocks(packed));
+    CHECK(decompress_corrupt_copies(packed, &dictionary) > 0);
+}
+
+// a corrupt dictionary file is rejected when loaded, not when it is used.
+TEST(dictionary_corrupt_file)
+{
+    Dictionary dictionary {};
+    CHECK(train_dictionary(dictionary));
+    std::vector<uint8_t> saved {};
+    dictionary.save(saved);
+
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    int failures { 0 };
+    for (size_t pos = 0; pos < saved.size(); ++pos)
+    {
+        Dictionary loaded {};
+        std::vector<uint8_t> corrupt { saved };
+        corrupt[pos] ^= 1 << (pos % 8);
+        failures += !loaded.load(corrupt.data(), corrupt.size());
+        failures += !loaded.load(saved.data(), pos);
+    }
+    std::cerr.rdbuf(errors);
+    CHECK(failures >= static_cast<int>(saved.size()));
+}
@@ -0,0 +1,72 @@
+#include <cstring>
+
+#include "test.h"
+
+std::vector<uint8_t> indexed_file()
+{
+    CompressOptions options {};
+    options.block_size = 4096;
+    return compress_bytes(make_corpus(CorpusKind::text, 40000), options);
+}
+
+void store_footer(std::vector<uint8_t>& packed, uint64_t block_count, uint64_t index_offset)
+{
+    uint8_t* footer { packed.data() + packed.size() - FOOTER_SIZE };
+    std::memcpy(footer, &block_count, sizeof(block_count));
+    std::memcpy(footer + 8, &index_offset, sizeof(index_offset));
+}
+
+TEST(index_of_compressed_file_is_read)
+{
+    std::vector<uint8_t> packed { indexed_file() };
+    std::vector<uint8_t> data {};
+    CHECK(packed.size() > FOOTER_SIZE && std::memcmp(packed.data() + packed.size() - 4, INDEX_MAGIC, 4) == 0);
+    CHECK(decompress_bytes(packed, data) && data == make_corpus(CorpusKind::text, 40000));
+}
+
+// a block count that fits the file but an index offset that only adds up to the 
+// file size by wrapping around 2^64.
+TEST(index_offset_that_wraps_is_rejected)
+{
+    std::vector<uint8_t> packed { indexed_file() };
+    uint64_t file_size { packed.size() };
+    uint64_t block_count { file_size / INDEX_ENTRY_SIZE };
+    store_footer(packed, block_count, file_size - FOOTER_SIZE - block_count * INDEX_ENTRY_SIZE);
+
+    std::vector<uint8_t> data {};
+    CHECK(!decompress_bytes(packed, data));
+}
+
+TEST(index_outside_the_blocks_is_rejected)
+{
+    std::vector<uint8_t> data {};
+    uint64_t file_size { indexed_file().size() };
+    for (uint64_t block_count : { uint64_t { 0 }, uint64_t { 1 }, (file_size - FOOTER_SIZE) / INDEX_ENTRY_SIZE, UINT64_MAX / INDEX_ENTRY_SIZE })
+    {
+        for (uint64_t index_offset : { uint64_t { 0 }, uint64_t { 4 }, file_size - FOOTER_SIZE, UINT64_MAX - FOOTER_SIZE })
+        {
+            std::vector<uint8_t> packed { indexed_file() };
+            store_footer(packed, block_count, index_offset);
+            CHECK(!decompress_bytes(packed, data));
+        }
+    }
+}
+
+// entries whose sizes don't add up to the blocks in front of the index.
+TEST(index_entries_that_overrun_the_blocks_are_rejected)
+{
+    std::vector<uint8_t> packed { indexed_file() };
+    uint64_t block_count {};
+    uint64_t index_offset {};
+    std::memcpy(&block_count, packed.data() + packed.size() - FOOTER_SIZE, sizeof(block_count));
+    std::memcpy(&index_offset, packed.data() + packed.size() - FOOTER_SIZE + 8, sizeof(index_offset));
+    CHECK(block_count > 1);
+
+    std::vector<uint8_t> data {};
+    for (uint32_t size : { uint32_t { 0 }, uint32_t { 1 }, uint32_t { 0x7fffffff }, UINT32_MAX })
+    {
+        std::vector<uint8_t> corrupt { packed };
+        std::memcpy(corrupt.data() + index_offset + 8, &size, sizeof(size));
+        CHECK(!decompress_bytes(corrupt, data));
+    }
+}
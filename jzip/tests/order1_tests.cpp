@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include "test.h"
+
+CompressOptions order1_options()
+{
+    CompressOptions options {};
+    options.context_model = true;
+    options.block_size = 65536;
+    return options;
+}
+
+// letters that mostly follow from the one before, which only order-1 tables see.
+std::vector<uint8_t> order1_test_data(size_t size)
+{
+    std::vector<uint8_t> random { make_corpus(CorpusKind::random, size) };
+    std::vector<uint8_t> data(size);
+    uint8_t previous { 0 };
+    for (size_t i = 0; i < size; ++i)
+    {
+        previous = random[i] < 230 ? (previous * 3 + 1) % 16 : random[i] % 16;
+        data[i] = 'A' + previous;
+    }
+    return data;
+}
+
+bool has_order1_blocks(const std::vector<uint8_t>& packed)
+{
+    std::vector<BlockMethod> methods { block_methods(packed) };
+    return std::find(methods.begin(), methods.end(), BlockMethod::huffman_order1) != methods.end();
+}
+
+TEST(order1_round_trips)
+{
+    for (CorpusKind kind : all_corpus_kinds())
+    {
+        CHECK(round_trips(make_corpus(kind, 150000), order1_options()));
+    }
+    CHECK(round_trips({}, order1_options()));
+    CHECK(round_trips({ 'a', 'b' }, order1_options()));
+
+    std::vector<uint8_t> data { order1_test_data(120000) };
+    std::vector<uint8_t> packed { compress_bytes(data, order1_options()) };
+    CHECK(has_order1_blocks(packed) && packed.size() < data.size() / 4);
+    CHECK(round_trips(data, order1_options()));
+
+    CompressOptions options { order1_options() };
+    options.coder = EntropyCoder::automatic;
+    options.max_code_length = 9;
+    CHECK(round_trips(data, options));
+    CHECK(round_trips(make_corpus(CorpusKind::text, 150000), options));
+}
+
+TEST(order1_corrupt_input)
+{
+    std::vector<uint8_t> data { order1_test_data(60000) };
+    std::vector<uint8_t> packed { compress_bytes(data, order1_options()) };
+    CHECK(has_order1_blocks(packed));
+    CHECK(decompress_corrupt_copies(packed) > 0);
+
+    packed = compress_bytes(make_corpus(CorpusKind::text, 100000), order1_options());
+    CHECK(decompress_corrupt_copies(packed) > 0);
+}
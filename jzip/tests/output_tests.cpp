@@ -0,0 +1,119 @@
+#include <fstream>
+#include <sstream>
+
+#include "test.h"
+
+std::vector<uint8_t> output_test_data()
+{
+    return make_corpus(CorpusKind::logs, 300000);
+}
+
+// a mapped .jzip file of the test data in blocks small enough to be out of order.
+bool write_packed_file(const TempFile& file)
+{
+    CompressOptions options {};
+    options.block_size = 16384;
+    std::vector<uint8_t> packed { compress_bytes(output_test_data(), options) };
+    return !packed.empty() && file.write(packed);
+}
+
+std::string as_string(const std::vector<uint8_t>& data)
+{
+    return { data.begin(), data.end() };
+}
+
+// a seekable stream that already holds data, like a redirected standard output.
+TEST(decompressing_after_existing_output_keeps_it)
+{
+    TempFile packed_file { "data.jzip" };
+    CHECK(write_packed_file(packed_file));
+
+    InputSource input {};
+    CHECK(input.open(packed_file.path()) && input.is_mapped());
+    std::ostringstream output {};
+    output << "HELLO";
+    DecompressOptions options {};
+    options.threads = 4;
+    CHECK(decompress_file(input, output, options));
+    CHECK(output.str() == "HELLO" + as_string(output_test_data()));
+}
+
+// like jzip -dc file.jzip >> existing
+TEST(decompressing_to_a_file_opened_for_append_keeps_it)
+{
+    TempFile packed_file { "data.jzip" };
+    CHECK(write_packed_file(packed_file));
+    TempFile output_file { "data" };
+    CHECK(output_file.write({ 'H', 'E', 'L', 'L', 'O' }));
+
+    {
+        InputSource input {};
+        CHECK(input.open(packed_file.path()));
+        std::ofstream output { output_file.path(), std::ios::out | std::ios::binary | std::ios::app };
+        CHECK(decompress_file(input, output));
+    }
+
+    std::vector<uint8_t> data {};
+    CHECK(output_file.read(data) && as_string(data) == "HELLO" + as_string(output_test_data()));
+}
+
+TEST(decompressing_to_a_new_file_writes_blocks_in_place)
+{
+    TempFile packed_file { "data.jzip" };
+    CHECK(write_packed_file(packed_file));
+    TempFile output_file { "data" };
+
+    // over a longer file, which must be replaced.
+    CHECK(output_file.write(std::vector<uint8_t>(500000, 'x')));
+    {
+        InputSource input {};
+        CHECK(input.open(packed_file.path()));
+        DecompressOptions options {};
+        options.threads = 4;
+        CHECK(decompress_file(input, output_file.path(), options));
+    }
+
+    std::vector<uint8_t> data {};
+    CHECK(output_file.read(data) && data == output_test_data());
+}
+
+TEST(decompressing_to_a_path_counts_stats_and_fails_cleanly)
+{
+    TempFile packed_file { "data.jzip" };
+    CHECK(write_packed_file(packed_file));
+    TempFile output_file { "data" };
+
+    InputSource input {};
+    CHECK(input.open(packed_file.path()));
+    Stats stats {};
+    DecompressOptions options {};
+    options.threads = 2;
+    options.stats = &stats;
+    CHECK(decompress_file(input, output_file.path(), options));
+    CHECK(stats.output_bytes == output_test_data().size() && stats.blocks == (output_test_data().size() + 16383) / 16384);
+
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    InputSource again {};
+    CHECK(again.open(packed_file.path()));
+    CHECK(!decompress_file(again, output_file.directory() + "/missing/data", options));
+    std::cerr.rdbuf(errors);
+}
+
+// nothing is read or coded after the file header couldn't be written.
+TEST(compressing_to_a_failed_stream_stops_at_the_header)
+{
+    TempFile data_file { "data" };
+    CHECK(data_file.write(output_test_data()));
+    InputSource input {};
+    CHECK(input.open(data_file.path()));
+
+    std::ostringstream output {};
+    output.setstate(std::ios::badbit);
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    CHECK(!compress_file(input, output));
+    std::cerr.rdbuf(errors);
+
+    std::vector<uint8_t> rest(output_test_data().size());
+    size_t read {};
+    CHECK(input.read(rest.data(), rest.size(), read) && read == rest.size());
+}
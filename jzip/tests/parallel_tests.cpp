@@ -0,0 +1,37 @@
+#include <sstream>
+
+#include "test.h"
+
+// compresses a mapped file with the given pool size and block size.
+std::string compress_mapped(const TempFile& file, int threads, size_t block_size)
+{
+    InputSource input {};
+    std::ostringstream output {};
+    CompressOptions options {};
+    options.threads = threads;
+    options.block_size = block_size;
+    bool ok = input.open(file.path()) && compress_file(input, output, options);
+    return ok ? output.str() : std::string {};
+}
+
+// a single large block has its bytes counted by the idle workers too, which must
+// come to the same counts, and so the same file, as one worker alone.
+TEST(bytes_of_large_blocks_are_counted_on_the_pool)
+{
+    std::vector<uint8_t> data { make_corpus(CorpusKind::text, 9 << 20) };
+    TempFile file { "data" };
+    CHECK(file.write(data));
+
+    std::string alone { compress_mapped(file, 1, 16 << 20) };
+    CHECK(!alone.empty());
+    for (int threads : { 2, 4, 7 })
+    {
+        CHECK(compress_mapped(file, threads, 16 << 20) == alone);
+    }
+
+    // two blocks on four threads, with one helper each.
+    std::string two_blocks { compress_mapped(file, 4, 5 << 20) };
+    CHECK(two_blocks == compress_mapped(file, 1, 5 << 20));
+    std::vector<uint8_t> unpacked {};
+    CHECK(decompress_bytes({ two_blocks.begin(), two_blocks.end() }, unpacked) && unpacked == data);
+}
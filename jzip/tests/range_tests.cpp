@@ -0,0 +1,117 @@
+#include <cstring>
+#include <sstream>
+
+#include "test.h"
+
+std::vector<uint8_t> range_test_data()
+{
+    return make_corpus(CorpusKind::binary, 100000);
+}
+
+// the test data in blocks of 8 KiB, written to file.
+bool write_range_test_file(const TempFile& file, int level = 0)
+{
+    CompressOptions options {};
+    options.level = level;
+    options.block_size = 8192;
+    std::vector<uint8_t> packed { compress_bytes(range_test_data(), options) };
+    return !packed.empty() && file.write(packed);
+}
+
+bool decompress_file_range(const TempFile& file, uint64_t offset, uint64_t length, std::string& range)
+{
+    InputSource input {};
+    std::ostringstream output {};
+    DecompressOptions options {};
+    options.threads = 3;
+    bool ok = input.open(file.path()) && decompress_range(input, output, offset, length, options);
+    range = output.str();
+    return ok;
+}
+
+bool range_matches(const TempFile& file, uint64_t offset, uint64_t length)
+{
+    std::vector<uint8_t> data { range_test_data() };
+    std::string range {};
+    size_t end { static_cast<size_t>(std::min<uint64_t>(data.size(), offset + std::min<uint64_t>(length, data.size()))) };
+    return decompress_file_range(file, offset, length, range) && range == std::string(data.begin() + offset, data.begin() + end);
+}
+
+TEST(range_decode_matches_the_data)
+{
+    for (int level : { 0, 5 })
+    {
+        TempFile file { "data.jzip" };
+        CHECK(write_range_test_file(file, level));
+
+        // inside a block, across block edges, whole blocks, the end and the whole file.
+        CHECK(range_matches(file, 100, 50));
+        CHECK(range_matches(file, 8000, 400));
+        CHECK(range_matches(file, 8192, 8192));
+        CHECK(range_matches(file, 8191, 3 * 8192 + 2));
+        CHECK(range_matches(file, 99990, 10));
+        CHECK(range_matches(file, 0, 100000));
+        CHECK(range_matches(file, 0, UINT64_MAX));
+        CHECK(range_matches(file, 12345, 0));
+        CHECK(range_matches(file, 100000, 10));
+    }
+}
+
+TEST(range_decode_cuts_ranges_short_at_the_end)
+{
+    TempFile file { "data.jzip" };
+    CHECK(write_range_test_file(file));
+    std::string range {};
+    CHECK(decompress_file_range(file, 99000, 5000, range) && range.size() == 1000);
+    CHECK(decompress_file_range(file, 99999, UINT64_MAX, range) && range.size() == 1);
+
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    CHECK(!decompress_file_range(file, 100001, 1, range));
+    CHECK(!decompress_file_range(file, UINT64_MAX, UINT64_MAX, range));
+    std::cerr.rdbuf(errors);
+}
+
+// a file cut off after its end marker has no index, and its blocks are found 
+// by walking their headers.
+TEST(range_decode_without_an_index)
+{
+    TempFile file { "data.jzip" };
+    CHECK(write_range_test_file(file));
+    std::vector<uint8_t> packed {};
+    CHECK(file.read(packed) && packed.size() > FOOTER_SIZE);
+    uint64_t index_offset {};
+    std::memcpy(&index_offset, packed.data() + packed.size() - FOOTER_SIZE + 8, sizeof(index_offset));
+    CHECK(index_offset < packed.size() && packed[index_offset - 1] == static_cast<uint8_t>(BlockMethod::end));
+    packed.resize(index_offset);
+    CHECK(file.write(packed));
+
+    CHECK(range_matches(file, 8191, 3 * 8192 + 2));
+    CHECK(range_matches(file, 0, UINT64_MAX));
+}
+
+// every corrupt copy must fail or extract some bytes, without reading outside the file.
+TEST(range_decode_corrupt_input)
+{
+    TempFile file { "data.jzip" };
+    CHECK(write_range_test_file(file, 5));
+    std::vector<uint8_t> packed {};
+    CHECK(file.read(packed));
+
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    int failures { 0 };
+    std::string range {};
+    size_t step { std::max<size_t>(packed.size() / 150, 1) };
+    for (size_t pos = 0; pos < packed.size(); pos += step)
+    {
+        std::vector<uint8_t> corrupt { packed };
+        corrupt[pos] ^= 0x10;
+        CHECK(file.write(corrupt));
+        failures += !decompress_file_range(file, 20000, 30000, range);
+        CHECK(range.size() <= 30000);
+
+        CHECK(file.write({ packed.begin(), packed.begin() + pos }));
+        failures += !decompress_file_range(file, 0, UINT64_MAX, range);
+    }
+    std::cerr.rdbuf(errors);
+    CHECK(failures > 0);
+}
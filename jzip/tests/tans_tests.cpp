@@ -0,0 +1,60 @@
+#include "test.h"
+
+CompressOptions tans_options(EntropyCoder coder = EntropyCoder::tans)
+{
+    CompressOptions options {};
+    options.coder = coder;
+    options.block_size = 65536;
+    return options;
+}
+
+TEST(tans_round_trips)
+{
+    for (CorpusKind kind : all_corpus_kinds())
+    {
+        CHECK(round_trips(make_corpus(kind, 150000), tans_options()));
+        CHECK(round_trips(make_corpus(kind, 150000), tans_options(EntropyCoder::automatic)));
+    }
+    CHECK(round_trips({}, tans_options()));
+    CHECK(round_trips({ 'a' }, tans_options()));
+    CHECK(round_trips({ 'a', 'b' }, tans_options()));
+    CHECK(round_trips(std::vector<uint8_t>(70000, 'z'), tans_options()));
+
+    // one byte far more common than the rest, and bytes seen once, which the
+    // normalized counts must still give a slot.
+    std::vector<uint8_t> data(100000, 0);
+    for (int symbol = 1; symbol < 256; ++symbol)
+    {
+        data[symbol * 389] = symbol;
+    }
+    CHECK(round_trips(data, tans_options()));
+
+    CompressOptions options { tans_options() };
+    options.level = 6;
+    CHECK(round_trips(make_corpus(CorpusKind::logs, 300000), options));
+}
+
+// tANS spends fractions of bits, which skewed data can't get from Huffman codes.
+TEST(tans_codes_skewed_blocks)
+{
+    std::vector<uint8_t> skewed { make_corpus(CorpusKind::skewed, 200000) };
+    std::vector<uint8_t> tans { compress_bytes(skewed, tans_options()) };
+    std::vector<uint8_t> huffman { compress_bytes(skewed, tans_options(EntropyCoder::huffman)) };
+    CHECK(!block_methods(tans).empty());
+    for (BlockMethod method : block_methods(tans))
+    {
+        CHECK(method == BlockMethod::tans);
+    }
+    CHECK(!tans.empty() && tans.size() < huffman.size());
+}
+
+TEST(tans_corrupt_input)
+{
+    std::vector<uint8_t> packed { compress_bytes(make_corpus(CorpusKind::skewed, 100000), tans_options()) };
+    CHECK(decompress_corrupt_copies(packed) > 0);
+
+    CompressOptions options { tans_options() };
+    options.level = 5;
+    packed = compress_bytes(make_corpus(CorpusKind::text, 100000), options);
+    CHECK(decompress_corrupt_copies(packed) > 0);
+}
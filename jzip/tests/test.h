@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compress.h"
+#include "decompress.h"
+#include "corpus.h"
+
+// A small test harness: TEST(name) defines a test that jzip_tests runs, CHECK
+// records a failed condition and lets the test go on. The helpers run data
+// through the in-memory contexts and through files on disk.
+
+struct TestCase
+{
+    const char* name {};
+    void (*run)() {};
+};
+
+std::vector<TestCase>& test_cases();
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, void (*run)());
+};
+
+void report_failure(const char* file, int line, const char* expression);
+
+#define TEST(name) \
+    void name(); \
+    TestRegistrar name##_registrar { #name, name }; \
+    void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) report_failure(__FILE__, __LINE__, #condition); } while (false)
+
+std::vector<uint8_t> make_corpus(CorpusKind kind, size_t size, uint64_t seed = 1);
+
+// a whole jzip file compressed from data, empty when compression failed.
+std::vector<uint8_t> compress_bytes(const std::vector<uint8_t>& data, const CompressOptions& options);
+
+// fails on corrupt input instead of returning whatever was decoded.
+bool decompress_bytes(const std::vector<uint8_t>& packed, std::vector<uint8_t>& data, const Dictionary* dictionary = nullptr);
+
+// compresses and decompresses data, true when the result is data again.
+bool round_trips(const std::vector<uint8_t>& data, const CompressOptions& options);
+
+// decompresses copies of a jzip file with bits flipped all over it and cut short
+// at many lengths. Each must fail or decode to some data, without crashing or
+// reading outside the input; returns how many of them failed.
+int decompress_corrupt_copies(const std::vector<uint8_t>& packed, const Dictionary* dictionary = nullptr);
+
+// the block method of every top level block of a jzip file, in order.
+std::vector<BlockMethod> block_methods(const std::vector<uint8_t>& packed);
+
+// a file in a directory of its own that is removed with it.
+class TempFile
+{
+private:
+    std::string m_directory {};
+    std::string m_path {};
+
+public:
+    explicit TempFile(const std::string& name = "file");
+    ~TempFile();
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator= (const TempFile&) = delete;
+
+    const std::string& path() const { return m_path; }
+    const std::string& directory() const { return m_directory; }
+    bool write(const std::vector<uint8_t>& data) const;
+    bool read(std::vector<uint8_t>& data) const;
+};
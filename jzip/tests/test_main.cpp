@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "test.h"
+
+int failure_count {};
+
+std::vector<TestCase>& test_cases()
+{
+    static std::vector<TestCase> cases {};
+    return cases;
+}
+
+TestRegistrar::TestRegistrar(const char* name, void (*run)())
+{
+    test_cases().push_back({ name, run });
+}
+
+void report_failure(const char* file, int line, const char* expression)
+{
+    std::cerr << file << ":" << line << ": CHECK(" << expression << ") failed\n";
+    ++failure_count;
+}
+
+std::vector<uint8_t> make_corpus(CorpusKind kind, size_t size, uint64_t seed)
+{
+    std::vector<uint8_t> data(size);
+    CorpusGenerator generator { kind, seed };
+    generator.generate(data.data(), data.size());
+    return data;
+}
+
+std::vector<uint8_t> compress_bytes(const std::vector<uint8_t>& data, const CompressOptions& options)
+{
+    CompressContext compressor { options };
+    std::vector<uint8_t> packed(compress_bound(data.size(), options.block_size));
+    size_t packed_size {};
+    if (!compressor.compress(data.data(), data.size(), packed.data(), packed.size(), packed_size))
+    {
+        return {};
+    }
+    packed.resize(packed_size);
+    return packed;
+}
+
+bool decompress_bytes(const std::vector<uint8_t>& packed, std::vector<uint8_t>& data, const Dictionary* dictionary)
+{
+    DecompressContext decompressor { dictionary };
+    uint64_t size {};
+    if (!decompressor.decompressed_size(packed.data(), packed.size(), size) || size > (uint64_t { 1 } << 32))
+    {
+        return false;
+    }
+    data.resize(size);
+    size_t data_size {};
+    return decompressor.decompress(packed.data(), packed.size(), data.data(), data.size(), data_size) && data_size == size;
+}
+
+bool round_trips(const std::vector<uint8_t>& data, const CompressOptions& options)
+{
+    std::vector<uint8_t> packed { compress_bytes(data, options) };
+    std::vector<uint8_t> unpacked {};
+    return !packed.empty() && decompress_bytes(packed, unpacked, options.dictionary) && unpacked == data;
+}
+
+int decompress_corrupt_copies(const std::vector<uint8_t>& packed, const Dictionary* dictionary)
+{
+    // error messages of the failing copies would drown the test report.
+    std::streambuf* errors { std::cerr.rdbuf(nullptr) };
+    int failures { 0 };
+    std::vector<uint8_t> data {};
+    size_t step { std::max<size_t>(packed.size() / 200, 1) };
+    for (size_t pos = 0; pos < packed.size(); pos += step)
+    {
+        std::vector<uint8_t> corrupt { packed };
+        corrupt[pos] ^= 1 << (pos % 8);
+        failures += !decompress_bytes(corrupt, data, dictionary);
+
+        std::vector<uint8_t> truncated { packed.begin(), packed.begin() + pos };
+        failures += !decompress_bytes(truncated, data, dictionary);
+    }
+    std::cerr.rdbuf(errors);
+    return failures;
+}
+
+std::vector<BlockMethod> block_methods(const std::vector<uint8_t>& packed)
+{
+    std::vector<BlockMethod> methods {};
+    size_t pos { packed.size() > FILE_HEADER_SIZE ? file_header_size(packed[FILE_HEADER_SIZE - 1]) : packed.size() };
+    while (pos + BLOCK_HEADER_SIZE <= packed.size() && packed[pos] != static_cast<uint8_t>(BlockMethod::end))
+    {
+        methods.push_back(static_cast<BlockMethod>(packed[pos]));
+        uint32_t payload_size {};
+        std::memcpy(&payload_size, packed.data() + pos + 5, sizeof(payload_size));
+        pos += BLOCK_HEADER_SIZE + payload_size;
+    }
+    return methods;
+}
+
+TempFile::TempFile(const std::string& name)
+{
+    std::string pattern { (std::filesystem::temp_directory_path() / "jzip_tests_XXXXXX").string() };
+    if (mkdtemp(pattern.data()))
+    {
+        m_directory = pattern;
+    }
+    m_path = m_directory + "/" + name;
+}
+
+TempFile::~TempFile()
+{
+    std::error_code error {};
+    if (!m_directory.empty())
+    {
+        std::filesystem::remove_all(m_directory, error);
+    }
+}
+
+bool TempFile::write(const std::vector<uint8_t>& data) const
+{
+    std::ofstream file { m_path, std::ios::out | std::ios::binary | std::ios::trunc };
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    file.close();
+    return !file.fail();
+}
+
+bool TempFile::read(std::vector<uint8_t>& data) const
+{
+    std::ifstream file { m_path, std::ios::in | std::ios::binary };
+    data.assign(std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {});
+    return !file.bad();
+}
+
+// runs every test, or those whose names contain the first argument.
+int main(int argc, char* argv[])
+{
+    const char* filter { argc > 1 ? argv[1] : "" };
+    int run_count { 0 };
+    for (const TestCase& test : test_cases())
+    {
+        if (std::strstr(test.name, filter) == nullptr)
+        {
+            continue;
+        }
+        int failures_before { failure_count };
+        test.run();
+        ++run_count;
+        std::cout << (failure_count == failures_before ? "ok    " : "FAIL  ") << test.name << "\n";
+    }
+
+    std::cout << run_count << " tests, " << failure_count << " failed checks\n";
+    return failure_count == 0 && run_count > 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+#include <thread>
+
+#include "thread_pool.h"
+
+// the pool and queue of the worker running on this thread, if any.
+thread_local const ThreadPool* current_pool {};
+thread_local size_t current_queue {};
+
+ThreadPool::ThreadPool(int thread_count)
+{
+    for (int i = 0; i < thread_count; ++i)
+    {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < thread_count; ++i)
+    {
+        m_workers.emplace_back([this, i]() { run_worker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const
+{
+    return m_workers.size();
+}
+
+void ThreadPool::push(std::function<void()> task)
+{
+    // counted under m_mutex, so a worker about to sleep either sees the task or 
+    // gets the notification. Counting first keeps the count from dropping below 
+    // zero when the task is taken straight away.
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        ++m_pending;
+    }
+
+    size_t index { current_pool == this ? current_queue : m_next_queue++ % m_queues.size() };
+    {
+        std::lock_guard<std::mutex> lock { m_queues[index]->mutex };
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+bool ThreadPool::take(size_t index, std::function<void()>& task)
+{
+    // the worker's own queue first, oldest task first.
+    {
+        Queue& queue { *m_queues[index] };
+        std::lock_guard<std::mutex> lock { queue.mutex };
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --m_pending;
+            return true;
+        }
+    }
+
+    // then the newest task of the other queues, the end their owners get to last.
+    for (size_t i = 1; i < m_queues.size(); ++i)
+    {
+        Queue& queue { *m_queues[(index + i) % m_queues.size()] };
+        std::lock_guard<std::mutex> lock { queue.mutex };
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --m_pending;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run_worker(size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+
+    while (true)
+    {
+        std::function<void()> task {};
+        if (take(index, task))
+        {
+            task();
+            continue;
+        }
+
+        // finish the queued tasks before stopping.
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_condition.wait(lock, [this]() { return m_stopping || m_pending > 0; });
+        if (m_pending == 0)
+        {
+            return;
+        }
+    }
+}
+
+int default_thread_count()
+{
+    unsigned int count { std::thread::hardware_concurrency() };
+    return count > 0 ? count : 1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task queue each. submit() returns a future
+// for the task's result. Tasks submitted from outside the pool are dealt to the
+// queues in turn, tasks submitted by a worker go to its own queue. Workers take
+// their own tasks oldest first, and a worker whose queue is empty steals the
+// newest task of another, so a queue that got the slow tasks doesn't hold up the
+// rest. Several callers can share one pool, like the files of a batch.
+class ThreadPool
+{
+private:
+    struct Queue
+    {
+        std::deque<std::function<void()>> tasks {};
+        std::mutex mutex {};
+    };
+
+    std::vector<std::thread> m_workers {};
+    std::vector<std::unique_ptr<Queue>> m_queues {};
+    std::atomic<size_t> m_next_queue {};
+    std::atomic<size_t> m_pending {}; // queued tasks not yet taken
+    std::mutex m_mutex {};            // guards sleeping and waking workers
+    std::condition_variable m_condition {};
+    bool m_stopping {};
+
+    void push(std::function<void()> task);
+    bool take(size_t index, std::function<void()>& task);
+    void run_worker(size_t index);
+
+public:
+    explicit ThreadPool(int thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+
+    int size() const;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& task)
+    {
+        // std::function needs a copyable target, so the task is shared.
+        auto packaged { std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(task)) };
+        std::future<std::invoke_result_t<F>> result { packaged->get_future() };
+        push([packaged]() { (*packaged)(); });
+
+        return result;
+    }
+};
+
+// number of threads to use when none is requested: one per hardware thread.
+int default_thread_count();